@@ -0,0 +1,331 @@
+// Runs the synthesis program over a set of benchmarks, by default every
+// TestCases/benchmark*.txt, and reports the stage timers and event counters
+// of metrics.hpp, wirelengths and peak memory as JSON. Each benchmark runs
+// a few times unmeasured first, then the measured times are summarized
+#include "../context.hpp"
+#include "../logging.hpp"
+#include "../metrics.hpp"
+#include "../parallel.hpp"
+#include "../sinkdb.hpp"
+#include "../synthesis.hpp"
+#include "../utilities.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+using namespace std;
+
+const int benchmarkBound = 150; // MIV bound per tier, as in main.cpp
+
+// What one run of a benchmark measured
+struct BenchmarkRun {
+  vector<double> seconds; // One per timer of the run's Metrics
+  long peakRSS;           // KiB
+};
+
+// What a benchmark gives regardless of the run. The counts and wirelengths
+// do not depend on timing or the thread count
+struct BenchmarkResult {
+  string path;
+  int sinks = 0;
+  int tiers = 0;
+  int clusters = 0;
+  int idealWirelength = 0;
+  int zeroSkewWirelength = 0;
+  vector<long long> counters; // One per counter of the run's Metrics
+  vector<BenchmarkRun> runs; // The measured ones
+  string error;              // Why the benchmark stopped, empty if it ran
+};
+
+// Starts a new peak resident set size window. Linux resets the process's
+// high water mark on request, elsewhere the peak covers the whole process
+bool resetPeakRSS() {
+  ofstream clearRefs("/proc/self/clear_refs");
+  return clearRefs && (clearRefs << "5").flush();
+}
+
+// Peak resident set size in KiB since the last reset
+long peakRSS() {
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return stol(line.substr(6));
+    }
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Synthesizes the benchmark once from a fresh context. The run's log goes
+// nowhere, its output files to outputPrefix
+BenchmarkRun runBenchmark(BenchmarkResult &result, unsigned threads,
+                          const string &outputPrefix) {
+  SynthesisContext ctx;
+  ctx.threads = threads;
+  ctx.outputPrefix = outputPrefix;
+  cleanupPreviousFiles(ctx);
+  resetPeakRSS();
+
+  ScopedTimer totalTimer(ctx.metrics, Timer::Total);
+  readDesign(ctx, result.path);
+  DesignState design = synthesizeDesign(ctx, benchmarkBound);
+  totalTimer.stop();
+  BenchmarkRun run;
+  for (int t = 0; t < (int)Timer::Count; t++) {
+    run.seconds.push_back(ctx.metrics.seconds((Timer)t));
+  }
+  run.peakRSS = peakRSS();
+
+  result.sinks = ctx.numSinks;
+  result.tiers = (int)design.tiers.size();
+  result.clusters = 0;
+  for (const auto &tier : design.tiers) {
+    result.clusters += (int)tier.second.clusters.size();
+  }
+  result.idealWirelength = idealWirelength(design);
+  result.zeroSkewWirelength = zeroSkewWirelength(design);
+  result.counters.clear();
+  for (int c = 0; c < (int)Counter::Count; c++) {
+    result.counters.push_back(ctx.metrics.value((Counter)c));
+  }
+  return run;
+}
+
+// Orders file names with their numbers compared by value, so benchmark2
+// comes before benchmark10
+bool naturalLess(const string &a, const string &b) {
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j])) {
+      size_t iEnd = i, jEnd = j;
+      while (iEnd < a.size() && isdigit((unsigned char)a[iEnd]))
+        iEnd++;
+      while (jEnd < b.size() && isdigit((unsigned char)b[jEnd]))
+        jEnd++;
+      unsigned long long x = stoull(a.substr(i, iEnd - i));
+      unsigned long long y = stoull(b.substr(j, jEnd - j));
+      if (x != y) {
+        return x < y;
+      }
+      i = iEnd;
+      j = jEnd;
+    } else if (a[i] != b[j]) {
+      return a[i] < b[j];
+    } else {
+      i++;
+      j++;
+    }
+  }
+  return a.size() - i < b.size() - j;
+}
+
+// The benchmark files given, directories expanded to their benchmark*.txt
+vector<string> benchmarkFiles(const vector<string> &paths) {
+  vector<string> files;
+  for (const string &path : paths) {
+    if (!filesystem::is_directory(path)) {
+      files.push_back(path);
+      continue;
+    }
+    vector<string> found;
+    for (const auto &entry : filesystem::directory_iterator(path)) {
+      string name = entry.path().filename().string();
+      if (entry.is_regular_file() && name.compare(0, 9, "benchmark") == 0 &&
+          entry.path().extension() == ".txt") {
+        found.push_back(entry.path().string());
+      }
+    }
+    sort(found.begin(), found.end(), naturalLess);
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  return files;
+}
+
+string jsonString(const string &text) {
+  ostringstream out;
+  out << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if ((unsigned char)c < 0x20) {
+      out << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+// Minimum, median and mean of the measured runs of one timer, in ms
+void writeTimerStats(ostream &out, const vector<BenchmarkRun> &runs,
+                     int timer) {
+  vector<double> ms;
+  for (const BenchmarkRun &run : runs) {
+    ms.push_back(run.seconds[timer] * 1e3);
+  }
+  sort(ms.begin(), ms.end());
+  size_t n = ms.size();
+  double median = n % 2 ? ms[n / 2] : (ms[n / 2 - 1] + ms[n / 2]) / 2;
+  double mean = 0.0;
+  for (double value : ms) {
+    mean += value / n;
+  }
+  out << "{\"minMs\": " << ms.front() << ", \"medianMs\": " << median
+      << ", \"meanMs\": " << mean << "}";
+}
+
+void writeJSON(ostream &out, const vector<BenchmarkResult> &results,
+               int runs, int warmup, unsigned threads, bool peakPerRun) {
+  out << setprecision(6) << fixed;
+  out << "{\n";
+  out << "  \"runs\": " << runs << ",\n";
+  out << "  \"warmup\": " << warmup << ",\n";
+  out << "  \"threads\": " << threads << ",\n";
+  out << "  \"logLevel\": " << MMM_LOG_LEVEL << ",\n";
+  // Whether peakRssKiB covers a run or everything the process did before
+  out << "  \"peakRssPerRun\": " << (peakPerRun ? "true" : "false") << ",\n";
+  out << "  \"benchmarks\": [";
+  for (size_t b = 0; b < results.size(); b++) {
+    const BenchmarkResult &result = results[b];
+    out << (b ? ",\n" : "\n") << "    {\n";
+    out << "      \"path\": " << jsonString(result.path) << ",\n";
+    if (!result.error.empty()) {
+      out << "      \"error\": " << jsonString(result.error) << "\n    }";
+      continue;
+    }
+    out << "      \"sinks\": " << result.sinks << ",\n";
+    out << "      \"tiers\": " << result.tiers << ",\n";
+    out << "      \"clusters\": " << result.clusters << ",\n";
+    out << "      \"idealWirelength\": " << result.idealWirelength << ",\n";
+    out << "      \"zeroSkewWirelength\": " << result.zeroSkewWirelength
+        << ",\n";
+    out << "      \"counters\": {";
+    for (int c = 0; c < (int)Counter::Count; c++) {
+      out << (c ? ", " : "") << jsonString(counterNames[c]) << ": "
+          << result.counters[c];
+    }
+    out << "},\n";
+    long peak = 0;
+    for (const BenchmarkRun &run : result.runs) {
+      peak = max(peak, run.peakRSS);
+    }
+    out << "      \"peakRssKiB\": " << peak << ",\n";
+    out << "      \"timers\": {";
+    for (int t = 0; t < (int)Timer::Count; t++) {
+      out << (t ? ",\n" : "\n") << "        " << jsonString(timerNames[t])
+          << ": ";
+      writeTimerStats(out, result.runs, t);
+    }
+    out << "\n      }\n    }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 5;
+  int warmup = 1;
+  unsigned threads = defaultThreadCount();
+  string outputDir = "benchmark_output";
+  string jsonFile;
+  vector<string> paths;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; i++) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--runs" && hasValue) {
+      runs = atoi(argv[++i]);
+      usage = runs < 1;
+    } else if (arg == "--warmup" && hasValue) {
+      warmup = atoi(argv[++i]);
+      usage = warmup < 0;
+    } else if (arg == "--threads" && hasValue) {
+      int count = atoi(argv[++i]);
+      usage = count < 1;
+      threads = (unsigned)max(count, 1);
+    } else if (arg == "--output-dir" && hasValue) {
+      outputDir = argv[++i];
+    } else if (arg == "--json" && hasValue) {
+      jsonFile = argv[++i];
+    } else if (arg.compare(0, 2, "--") != 0) {
+      paths.push_back(arg);
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    cerr << "Usage: " << argv[0]
+         << " [--runs N] [--warmup N] [--threads N] [--output-dir DIR]"
+            " [--json FILE] [benchmark files or directories]"
+         << endl;
+    return 1;
+  }
+  if (paths.empty()) {
+    paths.push_back("TestCases");
+  }
+  vector<string> files = benchmarkFiles(paths);
+  if (files.empty()) {
+    cerr << "No benchmarks found" << endl;
+    return 1;
+  }
+  error_code created;
+  filesystem::create_directories(outputDir, created);
+  if (created) {
+    cerr << "Error creating " << outputDir << ": " << created.message()
+         << endl;
+    return 1;
+  }
+  string outputPrefix = (filesystem::path(outputDir) / "").string();
+  bool peakPerRun = resetPeakRSS();
+
+  vector<BenchmarkResult> results;
+  for (const string &file : files) {
+    BenchmarkResult result;
+    result.path = file;
+    // The program's log output is dropped, cout only carries the log
+    streambuf *coutBuf = cout.rdbuf(nullptr);
+    try {
+      for (int i = 0; i < warmup + runs; i++) {
+        BenchmarkRun run = runBenchmark(result, threads, outputPrefix);
+        if (i >= warmup) {
+          result.runs.push_back(run);
+        }
+      }
+    } catch (const exception &error) {
+      result.error = error.what();
+    }
+    cout.rdbuf(coutBuf);
+    if (result.error.empty()) {
+      double total = 0.0;
+      for (const BenchmarkRun &run : result.runs) {
+        total += run.seconds[(int)Timer::Total] / result.runs.size();
+      }
+      cerr << file << ": " << result.sinks << " sinks, " << fixed
+           << setprecision(3) << total * 1e3 << " ms" << endl;
+    } else {
+      cerr << file << ": " << result.error << endl;
+    }
+    results.push_back(result);
+  }
+
+  if (jsonFile.empty()) {
+    writeJSON(cout, results, runs, warmup, threads, peakPerRun);
+  } else {
+    ofstream out(jsonFile);
+    if (!out.is_open()) {
+      cerr << "Error opening file for writing: " << jsonFile << endl;
+      return 1;
+    }
+    writeJSON(out, results, runs, warmup, threads, peakPerRun);
+  }
+  return 0;
+}
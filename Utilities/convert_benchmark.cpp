@@ -0,0 +1,42 @@
+// Converts a text benchmark (TestCases/benchmark*.txt) into a sink database
+// (sinkdb.hpp), which the synthesis program maps instead of parsing
+#include "../sinkdb.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+int main(int argc, char *argv[]) {
+  string input, output;
+  bool tierSorted = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--tier-sorted") {
+      tierSorted = true;
+    } else if (input.empty()) {
+      input = arg;
+    } else if (output.empty()) {
+      output = arg;
+    } else {
+      input.clear();
+      break;
+    }
+  }
+  if (input.empty() || output.empty()) {
+    cerr << "Usage: " << argv[0]
+         << " <benchmark.txt> <output sink database> [--tier-sorted]" << endl;
+    return 1;
+  }
+
+  SynthesisContext ctx;
+  try {
+    parseInput(ctx, input);
+    writeSinkDatabase(ctx, output, tierSorted);
+  } catch (const runtime_error &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+  cout << "Wrote " << ctx.numSinks << " sinks"
+       << (tierSorted ? " sorted by tier" : "") << " to " << output << endl;
+  return 0;
+}
@@ -0,0 +1,338 @@
+// Generates benchmark designs of any size, as a text benchmark or a sink
+// database (sinkdb.hpp). The sinks follow one of several distributions,
+// and the same seed always gives the same design: the random numbers come
+// from mt19937_64, whose output the standard fixes, and are shaped here
+// rather than by the library's distributions, which differ between
+// implementations
+#include "../sinkdb.hpp"
+#include "testcase_parameters.hpp"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+// What to generate. The wire, buffer, TSV and clock source parameters are
+// those of Utilities/testcase_generator.py
+struct GeneratorOptions {
+  string output;
+  long long sinks = -1;
+  string distribution = "uniform";
+  uint64_t seed = 1;
+  int width = 1000, height = 1000;
+  int dies = 3;
+  int hotspots = 8;            // hotspot: number of hotspots
+  double spread = 0.03;        // hotspot: deviation, a fraction of the width
+  double imbalance = 0.25;     // imbalanced: sinks of a die over the die below
+  int siteSize = 8;            // duplicates: sinks sharing a site
+  double minCapacitance = 0.1; // fF, rounded to hundredths
+  double maxCapacitance = 10000;
+  bool binary = false;
+  bool tierSorted = false;
+};
+
+class SinkGenerator {
+public:
+  explicit SinkGenerator(const GeneratorOptions &options)
+      : options(options), engine(options.seed) {
+    if (options.distribution == "hotspot") {
+      // Centers keep two deviations away from the edges where they can
+      int marginX = min((int)(2 * spread()), options.width / 2);
+      int marginY = min((int)(2 * spread()), options.height / 2);
+      for (int i = 0; i < options.hotspots; i++) {
+        int x = uniformInt(marginX, options.width - marginX);
+        int y = uniformInt(marginY, options.height - marginY);
+        centers.push_back({x, y});
+      }
+    } else if (options.distribution == "grid") {
+      // A lattice over the layout with about the layout's aspect ratio
+      columns = max(1LL, (long long)ceil(sqrt((double)options.sinks *
+                                              options.width /
+                                              options.height)));
+      rows = max(1LL, (options.sinks + columns - 1) / columns);
+    } else if (options.distribution == "imbalanced") {
+      double weight = 1.0;
+      double total = 0.0;
+      for (int die = 0; die < options.dies; die++) {
+        total += weight;
+        dieWeights.push_back(total);
+        weight *= options.imbalance;
+      }
+      for (double &cumulative : dieWeights) {
+        cumulative /= total;
+      }
+    }
+  }
+
+  // Sink i of the design, sinks generated in order
+  Sink next(long long i) {
+    Sink sink;
+    const string &distribution = options.distribution;
+    if (distribution == "uniform") {
+      sink.x = uniformInt(0, options.width);
+      sink.y = uniformInt(0, options.height);
+      sink.z = uniformInt(1, options.dies);
+    } else if (distribution == "hotspot") {
+      const pair<int, int> &center =
+          centers[uniformInt(0, (int)centers.size() - 1)];
+      sink.x = clampTo(lround(center.first + gaussian() * spread()),
+                       options.width);
+      sink.y = clampTo(lround(center.second + gaussian() * spread()),
+                       options.height);
+      sink.z = uniformInt(1, options.dies);
+    } else if (distribution == "grid") {
+      long long column = i % columns, row = i / columns;
+      sink.x = (int)((2 * column + 1) * options.width / (2 * columns));
+      sink.y = (int)((2 * row + 1) * options.height / (2 * rows));
+      sink.z = uniformInt(1, options.dies);
+    } else if (distribution == "imbalanced") {
+      sink.x = uniformInt(0, options.width);
+      sink.y = uniformInt(0, options.height);
+      double pick = uniformReal();
+      sink.z = 1;
+      while (sink.z < options.dies && pick >= dieWeights[sink.z - 1]) {
+        sink.z++;
+      }
+    } else {
+      // duplicates: runs of siteSize sinks on one site, each exactly on it
+      // or one unit off in x and y, the cases adjustNearlyIdenticalCoords
+      // spreads apart. Sites repeat across dies
+      if (i % options.siteSize == 0) {
+        site = {uniformInt(0, options.width - 1),
+                uniformInt(0, options.height - 1)};
+      }
+      sink.x = site.first + uniformInt(0, 1);
+      sink.y = site.second + uniformInt(0, 1);
+      sink.z = uniformInt(1, options.dies);
+    }
+    sink.inputCapacitance =
+        uniformInt(lround(options.minCapacitance * 100),
+                   lround(options.maxCapacitance * 100)) /
+        100.0;
+    return sink;
+  }
+
+private:
+  // Uniform in [low, high], by rejection so no value is favored
+  int uniformInt(int low, int high) {
+    uint64_t range = (uint64_t)((int64_t)high - low) + 1;
+    uint64_t limit = UINT64_MAX - UINT64_MAX % range;
+    uint64_t value;
+    do {
+      value = engine();
+    } while (value >= limit);
+    return (int)(low + (int64_t)(value % range));
+  }
+
+  // Uniform in [0, 1), from the top 53 bits
+  double uniformReal() { return (engine() >> 11) * 0x1.0p-53; }
+
+  // Standard normal, by the Box-Muller transform
+  double gaussian() {
+    double u = 1.0 - uniformReal(); // In (0, 1], log(u) is finite
+    double v = uniformReal();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * acos(-1.0) * v);
+  }
+
+  double spread() const { return options.spread * options.width; }
+
+  static int clampTo(long value, int high) {
+    return (int)max(0L, min(value, (long)high));
+  }
+
+  const GeneratorOptions &options;
+  mt19937_64 engine;
+  vector<pair<int, int>> centers; // hotspot
+  long long columns = 1, rows = 1; // grid
+  vector<double> dieWeights;       // imbalanced, cumulative
+  pair<int, int> site;             // duplicates, the current site
+};
+
+void setDesignParameters(SynthesisContext &ctx,
+                         const GeneratorOptions &options) {
+  setTestCaseParameters(ctx, options.width, options.height, options.dies);
+  ctx.numSinks = (int)options.sinks;
+}
+
+void appendNumber(string &out, long long value) {
+  char digits[24];
+  to_chars_result result = to_chars(digits, digits + sizeof digits, value);
+  out.append(digits, result.ptr);
+}
+
+// Streams the design in the text benchmark format, so even designs too
+// large to hold in memory can be written
+void writeTextBenchmark(const GeneratorOptions &options) {
+  SynthesisContext ctx;
+  setDesignParameters(ctx, options);
+  ofstream out(options.output, ios::binary);
+  if (!out.is_open()) {
+    throw runtime_error("Error opening file for writing: " + options.output);
+  }
+  out << ctx.layout.width << " " << ctx.layout.height << " "
+      << ctx.layout.numDies << " // the layout area ((0,0) to ("
+      << ctx.layout.width << "um," << ctx.layout.height << "um)), # dies ("
+      << ctx.layout.numDies << ")\n";
+  out << ctx.wireUnits.resistance << " " << ctx.wireUnits.capacitance
+      << " // unit wire resistance (ohm/um), unit wire capacitance (fF/um)\n";
+  out << ctx.bufferUnits.outputResistance << " "
+      << ctx.bufferUnits.inputCapacitance << " "
+      << ctx.bufferUnits.intrinsicDelay
+      << " // Buffer: output resistance (ohm), input cap. (fF), intrinsic "
+         "delay (ps)\n";
+  out << ctx.tsvUnits.resistance << " " << ctx.tsvUnits.capacitance
+      << " // TSV (or MIV): resistance (ohm), capacitance (fF)\n";
+  out << ctx.clockSource.x << " " << ctx.clockSource.y << " "
+      << ctx.clockSource.z << " " << ctx.clockSource.outputResistance
+      << " // the location of the clock source and its output resistance "
+         "(ohm)\n";
+  out << options.sinks << " // # sinks\n";
+
+  // Sink lines go out in large writes. The capacitance is a whole number
+  // of hundredths, printed as such so text and binary designs agree
+  SinkGenerator generator(options);
+  string buffer;
+  for (long long i = 0; i < options.sinks; i++) {
+    Sink sink = generator.next(i);
+    long long hundredths = llround(sink.inputCapacitance * 100);
+    appendNumber(buffer, sink.x);
+    buffer += ' ';
+    appendNumber(buffer, sink.y);
+    buffer += ' ';
+    appendNumber(buffer, sink.z);
+    buffer += ' ';
+    appendNumber(buffer, hundredths / 100);
+    buffer += '.';
+    buffer += (char)('0' + hundredths / 10 % 10);
+    buffer += (char)('0' + hundredths % 10);
+    buffer += '\n';
+    if (buffer.size() >= (1 << 20)) {
+      out.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+  out.write(buffer.data(), buffer.size());
+  if (!out) {
+    throw runtime_error("Error writing file: " + options.output);
+  }
+}
+
+void writeBinaryBenchmark(const GeneratorOptions &options) {
+  SynthesisContext ctx;
+  setDesignParameters(ctx, options);
+  SinkGenerator generator(options);
+  ctx.sinks.reserve(options.sinks);
+  for (long long i = 0; i < options.sinks; i++) {
+    ctx.sinks.push_back(generator.next(i));
+  }
+  writeSinkDatabase(ctx, options.output, options.tierSorted);
+}
+
+// Checks the options make a design, the message says what does not
+string optionsError(const GeneratorOptions &options) {
+  const vector<string> distributions = {"uniform", "hotspot", "grid",
+                                        "imbalanced", "duplicates"};
+  if (options.output.empty() || options.sinks < 0) {
+    return "an output file and --sinks are required";
+  }
+  if (options.sinks > INT_MAX) {
+    return "at most " + to_string(INT_MAX) + " sinks";
+  }
+  if (find(distributions.begin(), distributions.end(),
+           options.distribution) == distributions.end()) {
+    return "unknown distribution " + options.distribution;
+  }
+  if (options.width < 2 || options.height < 2 || options.dies < 1) {
+    return "the layout needs a width and height of at least 2 and a die";
+  }
+  if (options.hotspots < 1 || options.spread <= 0 || options.siteSize < 1 ||
+      options.imbalance <= 0) {
+    return "--hotspots, --spread, --imbalance and --site-size must be "
+           "positive";
+  }
+  if (options.minCapacitance < 0 ||
+      options.minCapacitance > options.maxCapacitance) {
+    return "bad capacitance range";
+  }
+  if (options.tierSorted && !options.binary) {
+    return "--tier-sorted applies to --binary output";
+  }
+  return "";
+}
+
+int main(int argc, char *argv[]) {
+  GeneratorOptions options;
+  string error;
+  for (int i = 1; i < argc && error.empty(); i++) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--binary") {
+      options.binary = true;
+    } else if (arg == "--tier-sorted") {
+      options.tierSorted = true;
+    } else if (arg == "--sinks" && hasValue) {
+      options.sinks = atoll(argv[++i]);
+    } else if (arg == "--distribution" && hasValue) {
+      options.distribution = argv[++i];
+    } else if (arg == "--seed" && hasValue) {
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--width" && hasValue) {
+      options.width = atoi(argv[++i]);
+    } else if (arg == "--height" && hasValue) {
+      options.height = atoi(argv[++i]);
+    } else if (arg == "--dies" && hasValue) {
+      options.dies = atoi(argv[++i]);
+    } else if (arg == "--hotspots" && hasValue) {
+      options.hotspots = atoi(argv[++i]);
+    } else if (arg == "--spread" && hasValue) {
+      options.spread = atof(argv[++i]);
+    } else if (arg == "--imbalance" && hasValue) {
+      options.imbalance = atof(argv[++i]);
+    } else if (arg == "--site-size" && hasValue) {
+      options.siteSize = atoi(argv[++i]);
+    } else if (arg == "--capacitance" && i + 2 < argc) {
+      options.minCapacitance = atof(argv[++i]);
+      options.maxCapacitance = atof(argv[++i]);
+    } else if (arg.compare(0, 2, "--") != 0 && options.output.empty()) {
+      options.output = arg;
+    } else {
+      error = "unexpected argument " + arg;
+    }
+  }
+  if (error.empty()) {
+    error = optionsError(options);
+  }
+  if (!error.empty()) {
+    cerr << argv[0] << ": " << error << endl;
+    cerr << "Usage: " << argv[0]
+         << " <output> --sinks N [--distribution uniform|hotspot|grid|"
+            "imbalanced|duplicates] [--seed S] [--width W] [--height H]"
+            " [--dies D] [--hotspots K] [--spread F] [--imbalance R]"
+            " [--site-size K] [--capacitance MIN MAX] [--binary]"
+            " [--tier-sorted]"
+         << endl;
+    return 1;
+  }
+
+  try {
+    if (options.binary) {
+      writeBinaryBenchmark(options);
+    } else {
+      writeTextBenchmark(options);
+    }
+  } catch (const runtime_error &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+  cout << "Wrote " << options.sinks << " " << options.distribution
+       << " sinks to " << options.output << endl;
+  return 0;
+}
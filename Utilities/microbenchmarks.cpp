@@ -0,0 +1,364 @@
+// Times the core kernels of the synthesis program in isolation, over a range
+// of input sizes. For each kernel it reports the time per element at every
+// size and the exponent k of the best fit of time ~ size^k. Every kernel
+// here should scale as n or n log n, so a fitted exponent well above 1 is
+// flagged and makes the exit status 1
+#include "../clustering.hpp"
+#include "../context.hpp"
+#include "../dme.hpp"
+#include "../logging.hpp"
+#include "../structures.hpp"
+#include "../timing.hpp"
+#include "../tree.hpp"
+#include "../utilities.hpp"
+#include "testcase_parameters.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Exponents above this count as worse than n log n. Over sizes of 1000 to
+// 32000, n log n fits about 1.1, and cache misses at the larger sizes lift
+// linear tree walks to about 1.3. A quadratic kernel fits about 2
+const double exponentLimit = 1.5;
+
+// Kernels keep running until this much time was measured at a size
+const double minMeasuredSeconds = 0.2;
+const int minRepetitions = 3;
+const int maxRepetitions = 1000;
+
+const string exportFilename = "microbenchmark_export.txt";
+
+// Kernel results are stored here so the compiler keeps the work
+volatile double kept;
+
+// Best time of one run of a kernel at one size, and the number of elements
+// that run processed
+struct Measurement {
+  double seconds;
+  double elements;
+};
+
+struct Kernel {
+  string name;
+  string element; // What the time is per
+  function<Measurement(size_t n)> measure;
+};
+
+// Runs run() after an untimed setup() until enough time was measured, and
+// keeps the best run. run() returns the number of elements it processed
+Measurement bestRun(const function<void()> &setup,
+                    const function<double()> &run) {
+  Measurement best{numeric_limits<double>::infinity(), 0.0};
+  double measured = 0.0;
+  for (int repetition = 0;
+       repetition < minRepetitions ||
+       (measured < minMeasuredSeconds && repetition < maxRepetitions);
+       repetition++) {
+    setup();
+    auto start = chrono::steady_clock::now();
+    double elements = run();
+    double seconds = lapSeconds(start);
+    measured += seconds;
+    if (seconds < best.seconds) {
+      best = {seconds, elements};
+    }
+  }
+  return best;
+}
+
+// The design parameters of the TestCases benchmarks on a square layout
+void setDesignParameters(SynthesisContext &ctx, int side) {
+  setTestCaseParameters(ctx, side, side, 1);
+}
+
+// Side of a square layout holding n sinks at the density of the TestCases
+// benchmarks, about one sink per 60 x 60 units
+int layoutSide(size_t n) { return max(100, (int)(60 * sqrt((double)n))); }
+
+// n sinks of one tier spread uniformly, separated as a tier is before
+// synthesis. The same n always gives the same sinks
+vector<Sink> randomSinks(size_t n) {
+  mt19937_64 engine(n);
+  int side = layoutSide(n);
+  vector<Sink> sinks;
+  sinks.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    Sink sink;
+    sink.x = (int)(engine() % (side + 1));
+    sink.y = (int)(engine() % (side + 1));
+    sink.z = 1;
+    sink.inputCapacitance = 1 + engine() % 100;
+    sinks.push_back(sink);
+  }
+  adjustNearlyIdenticalCoords(sinks);
+  return sinks;
+}
+
+vector<Point> randomPoints(size_t n) {
+  vector<Point> points;
+  for (const Sink &sink : randomSinks(n)) {
+    points.push_back({(double)sink.x, (double)sink.y, 0});
+  }
+  return points;
+}
+
+// Abstract tree over the sinks, placed and timed the way synthesizeCluster
+// leaves it before merging
+Node *placedTree(SynthesisContext &ctx, const vector<Sink> &sinks) {
+  Node *root = AbsTreeGen3D(ctx, sinks, 149);
+  assignPhysicalLocations(root);
+  buildTiming(ctx, root, ctx.tsvUnits.resistance);
+  return root;
+}
+
+// A zero skew tree over n sinks, as synthesizeCluster builds it
+Node *zeroSkewTreeOf(SynthesisContext &ctx, size_t n) {
+  setDesignParameters(ctx, layoutSide(n));
+  Node *root = placedTree(ctx, randomSinks(n));
+  vector<Node *> bufferedNodes;
+  root = zeroSkewTree(ctx, root, &bufferedNodes);
+  retimeBufferedNodes(ctx, bufferedNodes);
+  return root;
+}
+
+// Internal nodes with two leaf children, the merges zero skew merging
+// starts from
+void collectLeafPairs(Node *node, vector<Node *> &pairs) {
+  if (!node || (!node->leftChild && !node->rightChild)) {
+    return;
+  }
+  Node *left = node->leftChild, *right = node->rightChild;
+  if (left && right && !left->leftChild && !left->rightChild &&
+      !right->leftChild && !right->rightChild) {
+    pairs.push_back(node);
+    return;
+  }
+  collectLeafPairs(left, pairs);
+  collectLeafPairs(right, pairs);
+}
+
+vector<Kernel> kernels() {
+  auto none = [] {};
+  return {
+      {"gridNeighbors", "point",
+       [=](size_t n) {
+         // The neighbourhood queries dbscan makes through its grid: every
+         // point's neighbours counted, then claimed
+         vector<Point> points = randomPoints(n);
+         return bestRun(none, [&] {
+           DBSCANGrid grid = buildDBSCANGrid(points, 60);
+           long long count = 0;
+           for (size_t i = 0; i < n; i++) {
+             count += gridCountNeighbors(grid, points, (int)i, 60, INT_MAX);
+           }
+           vector<int> claimed;
+           for (size_t i = 0; i < n; i++) {
+             gridClaimNeighbors(grid, points, (int)i, 60, claimed);
+           }
+           kept = count + claimed.size();
+           return (double)n;
+         });
+       }},
+      {"dbscan", "point",
+       [=](size_t n) {
+         vector<Point> points = randomPoints(n), input = points;
+         return bestRun([&] { points = input; },
+                        [&] {
+                          dbscan(points, 60, 1, 150);
+                          return (double)n;
+                        });
+       }},
+      {"calculateWirelength", "sink",
+       [=](size_t n) {
+         vector<Sink> sinks = randomSinks(n);
+         return bestRun(none, [&] {
+           kept = calculateWirelength(sinks);
+           return (double)n;
+         });
+       }},
+      {"AbsTreeGen3D", "sink",
+       [=](size_t n) {
+         SynthesisContext ctx;
+         setDesignParameters(ctx, layoutSide(n));
+         vector<Sink> sinks = randomSinks(n);
+         return bestRun([&] { releaseNodes(ctx); },
+                        [&] {
+                          AbsTreeGen3D(ctx, sinks, 149);
+                          return (double)n;
+                        });
+       }},
+      {"linear_planar_dme", "point",
+       [=](size_t n) {
+         vector<Point> points = randomPoints(n), input = points;
+         return bestRun([&] { points = input; },
+                        [&] {
+                          linear_planar_dme(points);
+                          return (double)n;
+                        });
+       }},
+      {"ZeroSkewMerge", "merge",
+       [=](size_t n) {
+         // Each pair of sibling leaves of a placed tree merged once, under
+         // the pair's parent as zeroSkewTreeSub merges them
+         SynthesisContext ctx;
+         setDesignParameters(ctx, layoutSide(n));
+         vector<Sink> sinks = randomSinks(n);
+         Node *root = nullptr;
+         vector<Node *> pairs;
+         LeafOccupancy occupancy;
+         return bestRun(
+             [&] {
+               releaseNodes(ctx);
+               root = placedTree(ctx, sinks);
+               pairs.clear();
+               collectLeafPairs(root, pairs);
+               buildLeafOccupancy(occupancy, root);
+             },
+             [&] {
+               for (Node *pair : pairs) {
+                 ZeroSkewMerge(ctx, occupancy, pair, pair->leftChild->id,
+                               pair->rightChild->id);
+               }
+               return (double)pairs.size();
+             });
+       }},
+      {"depthFirstCapacitance", "sink",
+       [=](size_t n) {
+         SynthesisContext ctx;
+         Node *root = zeroSkewTreeOf(ctx, n);
+         return bestRun(none, [&] {
+           kept = depthFirstCapacitance(root);
+           return (double)n;
+         });
+       }},
+      {"depthFirstDelay", "sink",
+       [=](size_t n) {
+         SynthesisContext ctx;
+         Node *root = zeroSkewTreeOf(ctx, n);
+         return bestRun(none, [&] {
+           depthFirstDelay(ctx, root, ctx.tsvUnits.resistance);
+           return (double)n;
+         });
+       }},
+      {"exportPointsAndLines", "sink",
+       [=](size_t n) {
+         SynthesisContext ctx;
+         Node *root = zeroSkewTreeOf(ctx, n);
+         return bestRun([&] { remove(exportFilename.c_str()); },
+                        [&] {
+                          exportPointsAndLines(root, exportFilename);
+                          return (double)n;
+                        });
+       }},
+  };
+}
+
+// Least squares slope of log(seconds) over log(size)
+double fittedExponent(const vector<size_t> &sizes,
+                      const vector<Measurement> &measurements) {
+  double n = sizes.size(), sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    double x = log((double)sizes[i]);
+    double y = log(measurements[i].seconds);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+  return (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+}
+
+// Parses a comma separated list of sizes, empty on a malformed one
+vector<size_t> parseSizes(const string &list) {
+  vector<size_t> sizes;
+  stringstream in(list);
+  string item;
+  while (getline(in, item, ',')) {
+    char *end;
+    unsigned long long size = strtoull(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || size < 2) {
+      return {};
+    }
+    sizes.push_back(size);
+  }
+  sort(sizes.begin(), sizes.end());
+  sizes.erase(unique(sizes.begin(), sizes.end()), sizes.end());
+  return sizes;
+}
+
+int main(int argc, char *argv[]) {
+  vector<size_t> sizes = {1000, 2000, 4000, 8000, 16000, 32000};
+  vector<string> selected;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; i++) {
+    string arg = argv[i];
+    if (arg == "--sizes" && i + 1 < argc) {
+      sizes = parseSizes(argv[++i]);
+      usage = sizes.empty();
+    } else if (arg.compare(0, 2, "--") != 0) {
+      selected.push_back(arg);
+    } else {
+      usage = true;
+    }
+  }
+  vector<Kernel> all = kernels();
+  for (const string &name : selected) {
+    usage = usage || none_of(all.begin(), all.end(), [&](const Kernel &k) {
+              return k.name == name;
+            });
+  }
+  if (usage) {
+    cerr << "Usage: " << argv[0] << " [--sizes N,N,...] [kernel...]" << endl;
+    cerr << "Kernels:";
+    for (const Kernel &kernel : all) {
+      cerr << " " << kernel.name;
+    }
+    cerr << endl;
+    return 1;
+  }
+
+  cout << left << setw(24) << "kernel" << right << setw(10) << "size"
+       << setw(14) << "ns/element" << "  element" << endl;
+  bool flagged = false;
+  for (const Kernel &kernel : all) {
+    if (!selected.empty() &&
+        find(selected.begin(), selected.end(), kernel.name) ==
+            selected.end()) {
+      continue;
+    }
+    vector<Measurement> measurements;
+    for (size_t n : sizes) {
+      // The kernels' log output is dropped
+      streambuf *coutBuf = cout.rdbuf(nullptr);
+      Measurement measurement = kernel.measure(n);
+      cout.rdbuf(coutBuf);
+      measurements.push_back(measurement);
+      cout << left << setw(24) << kernel.name << right << setw(10) << n
+           << setw(14) << fixed << setprecision(2)
+           << measurement.seconds * 1e9 / measurement.elements << "  "
+           << kernel.element << endl;
+    }
+    if (sizes.size() >= 2) {
+      double exponent = fittedExponent(sizes, measurements);
+      bool tooSteep = exponent > exponentLimit;
+      flagged = flagged || tooSteep;
+      cout << left << setw(24) << kernel.name << right << setw(10)
+           << "exponent" << setw(14) << setprecision(2) << exponent
+           << (tooSteep ? "  worse than n log n" : "") << endl;
+    }
+  }
+  remove(exportFilename.c_str());
+  return flagged ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "../context.hpp"
+using namespace std;
+
+// Sets the design parameters of the TestCases benchmarks, which are those
+// of Utilities/testcase_generator.py, on a width x height layout of dies
+// dies. The tools that make up designs share them from here
+void setTestCaseParameters(SynthesisContext &ctx, int width, int height,
+                           int dies) {
+  ctx.layout.width = width;
+  ctx.layout.height = height;
+  ctx.layout.numDies = dies;
+  ctx.wireUnits.resistance = 0.1;
+  ctx.wireUnits.capacitance = 0.2;
+  ctx.bufferUnits.outputResistance = 122;
+  ctx.bufferUnits.inputCapacitance = 24;
+  ctx.bufferUnits.intrinsicDelay = 17;
+  ctx.tsvUnits.resistance = 0.035;
+  ctx.tsvUnits.capacitance = 15;
+  ctx.clockSource.x = 50;
+  ctx.clockSource.y = 0;
+  ctx.clockSource.z = 1;
+  ctx.clockSource.outputResistance = 100;
+}
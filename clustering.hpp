@@ -7,41 +7,136 @@
 #include <fstream>
 #include <map>
 #include <set>
+#include <unordered_map>
 using namespace std;
 
 
-std::vector<int> regionQuery(const std::vector<Point> &points, int P,
-                             double eps) {
-  std::vector<int> neighbors;
-  for (int i = 0; i < points.size(); ++i) {
-    if (euclideanDistance(points[P], points[i]) <= eps) {
-      neighbors.push_back(i);
+// Points bucketed into eps-sized cells, so a neighbourhood query only looks
+// at the 3x3 cells around a point. Next to every cell's points the grid keeps
+// the ones no cluster has claimed yet, which lets expansion visit each point
+// once instead of appending whole neighbour lists over and over
+struct DBSCANGrid {
+  double cellSize;
+  double minX, minY;
+  const std::vector<int> *weights; // Per point, each counts once if null
+  std::unordered_map<long long, std::vector<int>> cells;
+  std::unordered_map<long long, std::vector<int>> unclaimed;
+};
+
+long long gridCellKey(long long cx, long long cy) {
+  return (long long)((unsigned long long)cx << 32) ^ (cy & 0xffffffffLL);
+}
+
+void gridCellOf(const DBSCANGrid &grid, const Point &p, long long &cx,
+                long long &cy) {
+  cx = (long long)floor((p.x - grid.minX) / grid.cellSize);
+  cy = (long long)floor((p.y - grid.minY) / grid.cellSize);
+}
+
+DBSCANGrid buildDBSCANGrid(const std::vector<Point> &points, double eps,
+                           const std::vector<int> *weights = nullptr) {
+  DBSCANGrid grid;
+  grid.weights = weights;
+  // Slightly wider than eps so rounding can never put two points that are
+  // eps apart more than one cell from each other
+  grid.cellSize = eps > 0 ? eps * (1 + 1e-9) : 1.0;
+  grid.minX = grid.minY = 0;
+  if (!points.empty()) {
+    grid.minX = points[0].x;
+    grid.minY = points[0].y;
+  }
+  for (const auto &point : points) {
+    grid.minX = std::min(grid.minX, point.x);
+    grid.minY = std::min(grid.minY, point.y);
+  }
+  for (size_t i = 0; i < points.size(); ++i) {
+    long long cx, cy;
+    gridCellOf(grid, points[i], cx, cy);
+    grid.cells[gridCellKey(cx, cy)].push_back((int)i);
+    // Only unvisited (0) and noise (-1) points can still join a cluster
+    if (points[i].clusterId <= 0) {
+      grid.unclaimed[gridCellKey(cx, cy)].push_back((int)i);
     }
   }
-  return neighbors;
+  return grid;
 }
-void expandCluster(std::vector<Point> &points, int P,
-                   std::vector<int> &neighbors, int clusterId, double eps,
-                   int minPts) {
-  points[P].clusterId = clusterId;
-  for (size_t i = 0; i < neighbors.size(); ++i) {
-    int neighborIndex = neighbors[i];
-    if (points[neighborIndex].clusterId == -1) {
-      points[neighborIndex].clusterId = clusterId;
+
+// Number of points within eps of P, each counted by its weight. Counting
+// stops once limit is reached
+int gridCountNeighbors(const DBSCANGrid &grid, const std::vector<Point> &points,
+                       int P, double eps, int limit) {
+  long long cx, cy;
+  gridCellOf(grid, points[P], cx, cy);
+  int count = 0;
+  for (long long dx = -1; dx <= 1; ++dx) {
+    for (long long dy = -1; dy <= 1; ++dy) {
+      auto it = grid.cells.find(gridCellKey(cx + dx, cy + dy));
+      if (it == grid.cells.end())
+        continue;
+      for (int i : it->second) {
+        if (euclideanDistance(points[P], points[i]) > eps)
+          continue;
+        count += grid.weights ? (*grid.weights)[i] : 1;
+        if (count >= limit)
+          return count;
+      }
     }
-    if (points[neighborIndex].clusterId == 0) {
-      points[neighborIndex].clusterId = clusterId;
-      std::vector<int> newNeighbors = regionQuery(points, neighborIndex, eps);
-      if (newNeighbors.size() >= minPts) {
-        neighbors.insert(neighbors.end(), newNeighbors.begin(),
-                         newNeighbors.end());
+  }
+  return count;
+}
+
+// Moves every unclaimed point within eps of P into claimed
+void gridClaimNeighbors(DBSCANGrid &grid, const std::vector<Point> &points,
+                        int P, double eps, std::vector<int> &claimed) {
+  long long cx, cy;
+  gridCellOf(grid, points[P], cx, cy);
+  for (long long dx = -1; dx <= 1; ++dx) {
+    for (long long dy = -1; dy <= 1; ++dy) {
+      auto it = grid.unclaimed.find(gridCellKey(cx + dx, cy + dy));
+      if (it == grid.unclaimed.end())
+        continue;
+      std::vector<int> &cell = it->second;
+      for (size_t k = 0; k < cell.size();) {
+        if (euclideanDistance(points[P], points[cell[k]]) <= eps) {
+          claimed.push_back(cell[k]);
+          cell[k] = cell.back();
+          cell.pop_back();
+        } else {
+          ++k;
+        }
       }
     }
   }
 }
 
-void dbscan(std::vector<Point> &points, double eps, int minPts, int bound) {
+// Grows a cluster from core point P. Labels match the classic expansion:
+// every point density reachable from P that is still unvisited or noise
+// joins the cluster, and only unvisited core points keep expanding
+void expandCluster(DBSCANGrid &grid, std::vector<Point> &points, int P,
+                   int clusterId, double eps, int minPts) {
+  std::vector<int> frontier;
+  points[P].clusterId = clusterId;
+  gridClaimNeighbors(grid, points, P, eps, frontier);
+  for (size_t i = 0; i < frontier.size(); ++i) {
+    int neighborIndex = frontier[i];
+    if (neighborIndex == P)
+      continue;
+    bool wasNoise = points[neighborIndex].clusterId == -1;
+    points[neighborIndex].clusterId = clusterId;
+    if (!wasNoise && gridCountNeighbors(grid, points, neighborIndex, eps,
+                                        minPts) >= minPts) {
+      gridClaimNeighbors(grid, points, neighborIndex, eps, frontier);
+    }
+  }
+}
+
+// Clusters points, each of which stands for weights[i] points at its
+// position when weights are given. Cluster sizes and neighbour counts add
+// up the weights
+void dbscan(std::vector<Point> &points, double eps, int minPts, int bound,
+            const std::vector<int> *weights = nullptr) {
   int clusterId = 0;
+  DBSCANGrid grid = buildDBSCANGrid(points, eps, weights);
 
   // First pass: Regular DBSCAN to find all clusters
   for (int i = 0; i < points.size(); ++i) {
@@ -49,20 +144,19 @@ void dbscan(std::vector<Point> &points, double eps, int minPts, int bound) {
       continue;
     }
 
-    std::vector<int> neighbors = regionQuery(points, i, eps);
-    if (neighbors.size() < minPts) {
+    if (gridCountNeighbors(grid, points, i, eps, minPts) < minPts) {
       points[i].clusterId = 0; // Mark as unclustered instead of -1
     } else {
       ++clusterId;
-      expandCluster(points, i, neighbors, clusterId, eps, minPts);
+      expandCluster(grid, points, i, clusterId, eps, minPts);
     }
   }
 
   // Count points in each cluster
   std::map<int, int> clusterSizes;
-  for (const auto &point : points) {
-    if (point.clusterId > 0) {
-      clusterSizes[point.clusterId]++;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (points[i].clusterId > 0) {
+      clusterSizes[points[i].clusterId] += weights ? (*weights)[i] : 1;
     }
   }
 
@@ -143,39 +237,48 @@ void outputDBSCANResults(const std::vector<Point> &points, int z,
 
   file.close();
 }
-void assignClusterIdsToLeafNodes(Node *node, const std::vector<Point> &points) {
+// Gives every leaf the cluster of the first point at its sink's position.
+// clusterAt maps a position (cellKey) to that cluster
+void assignClusterIdsToLeafNodes(
+    Node *node, const std::unordered_map<long long, int> &clusterAt) {
   if (!node)
     return;
 
   if (node->leftChild == nullptr &&
       node->rightChild == nullptr) { // Check if it's a leaf node
     for (const auto &sink : node->sinks) {
-      for (const auto &point : points) {
-        if (sink.x == point.x && sink.y == point.y) {
-          node->cluster_id = point.clusterId; // Assign cluster ID
-          break;
-        }
+      auto it = clusterAt.find(cellKey(sink.x, sink.y));
+      if (it != clusterAt.end()) {
+        node->cluster_id = it->second; // Assign cluster ID
       }
     }
   }
 
-  assignClusterIdsToLeafNodes(node->leftChild, points);
-  assignClusterIdsToLeafNodes(node->rightChild, points);
+  assignClusterIdsToLeafNodes(node->leftChild, clusterAt);
+  assignClusterIdsToLeafNodes(node->rightChild, clusterAt);
 }
 
-void runDBSCANAndAssignClusters(Node *root, double eps, int minPts, int bound) {
-  std::vector<Sink> sinks;
-  extractSinks(root, sinks);
-
-  std::vector<Point> points;
-  for (const auto &sink : sinks) {
-    points.push_back(
-        {static_cast<double>(sink.x), static_cast<double>(sink.y), 0});
+void assignClusterIdsToLeafNodes(Node *node, const std::vector<Point> &points) {
+  std::unordered_map<long long, int> clusterAt;
+  for (const auto &point : points) {
+    clusterAt.emplace(cellKey((int)point.x, (int)point.y), point.clusterId);
   }
+  assignClusterIdsToLeafNodes(node, clusterAt);
+}
 
-  dbscan(points, eps, minPts, bound); // Pass the bound parameter
+// Clusters the node points AbsTreeGen3D recorded for root's tree: every
+// sink once per node above and at its leaf, in input order within a node.
+// Reading the nodes' spans instead would see them in partition order, which
+// changes the clusters found, their numbering and which ones the bound
+// keeps
+void runDBSCANAndAssignClusters(const SynthesisContext &ctx, Node *root,
+                                NodePoints &nodePoints, double eps,
+                                int minPts, int bound) {
+  std::vector<Point> &points = nodePoints.points;
+  dbscan(points, eps, minPts, bound, &nodePoints.weights);
 
   assignClusterIdsToLeafNodes(root, points);
   outputDBSCANResults(points, root->z,
-                      "dbscan_results_z_" + std::to_string(root->z) + ".csv");
+                      ctx.outputPrefix + "dbscan_results_z_" +
+                          std::to_string(root->z) + ".csv");
 }
\ No newline at end of file
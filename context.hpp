@@ -0,0 +1,49 @@
+#pragma once
+#include "mapping.hpp"
+#include "metrics.hpp"
+#include "structures.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Everything one synthesis run reads and writes: the design read from the
+// benchmark file, the nodes built for it and the run's counters. Algorithms
+// take the context they work on instead of sharing globals, so several
+// designs can be synthesized in one process, side by side
+struct SynthesisContext {
+  // Design parameters and sinks, filled in by parseInput() or
+  // loadSinkDatabase(). Use designSinks() to read the sinks
+  Layout layout{};
+  WireUnits wireUnits{};
+  BufferUnits bufferUnits{};
+  TSVUnits tsvUnits{};
+  ClockSource clockSource{};
+  vector<Sink> sinks;                  // Parsed from a text benchmark
+  unique_ptr<MappedFile> sinkDatabase; // Or mapped from a sink database
+  SinkSpan databaseSinks;              // The sink array inside it
+  bool sinksTierSorted = false;        // Sinks come in ascending z order
+  int numSinks = 0;
+  string outputPrefix; // Prepended to the name of every file the run writes
+  unsigned threads = 1; // Threads the run may use
+
+  // Node storage, valid until releaseNodes()
+  atomic<int> nodeID{0};   // Next node id, safe to take from any thread
+  vector<Node *> nodeIndex; // Node lookup by id, filled in as ids are handed out
+  NodeArena nodeArena;      // Owns every Node created outside a cluster job
+  vector<unique_ptr<NodeArena>> jobArenas; // One per reserved node range
+  // Cluster midpoints of the tier being synthesized
+  unordered_map<int, pair<double, double>> clusterMidpoints;
+
+  Metrics metrics; // Stage timers and event counters (metrics.hpp)
+  Tracer tracer;   // Timeline of the run, when enabled (trace.hpp)
+};
+
+// The design's sinks, wherever they were read from
+SinkSpan designSinks(SynthesisContext &ctx) {
+  return ctx.sinkDatabase ? ctx.databaseSinks : SinkSpan(ctx.sinks);
+}
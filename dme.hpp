@@ -1,4 +1,6 @@
 #pragma once
+#include "logging.hpp"
+#include "parallel.hpp"
 #include "structures.hpp"
 #include "utilities.hpp"
 #include "tree.hpp"
@@ -7,6 +9,8 @@
 #include <fstream>
 #include <map>
 #include <set>
+#include <sstream>
+#include <tuple>
 using namespace std;
 
 vector<Point> findPoints(double x1, double y1, double mDist) {
@@ -18,35 +22,60 @@ vector<Point> findPoints(double x1, double y1, double mDist) {
   };
 }
 
-double radius(const std::vector<Point> &sinks) {
-  double max_dist = 0;
-  for (size_t i = 0; i < sinks.size(); ++i) {
-    for (size_t j = i + 1; j < sinks.size(); ++j) {
-      max_dist = std::max(max_dist, distance(sinks[i], sinks[j]));
-    }
+// Extremes of a point set in plain and 45 degree rotated coordinates,
+// gathered in a single pass. The Manhattan diameter is the larger spread of
+// x+y and x-y, so radius and center need no pairwise loop
+struct PointExtents {
+  double minX, maxX, minY, maxY;
+  double minSum, maxSum;   // x + y
+  double minDiff, maxDiff; // x - y
+};
+
+PointExtents pointExtents(const Point *first, const Point *last) {
+  PointExtents e = {0, 0, 0, 0, 0, 0, 0, 0};
+  if (first == last) {
+    return e;
+  }
+  e.minX = e.maxX = first->x;
+  e.minY = e.maxY = first->y;
+  e.minSum = e.maxSum = first->x + first->y;
+  e.minDiff = e.maxDiff = first->x - first->y;
+  for (const Point *p = first + 1; p != last; ++p) {
+    double sum = p->x + p->y;
+    double diff = p->x - p->y;
+    e.minX = std::min(e.minX, p->x);
+    e.maxX = std::max(e.maxX, p->x);
+    e.minY = std::min(e.minY, p->y);
+    e.maxY = std::max(e.maxY, p->y);
+    e.minSum = std::min(e.minSum, sum);
+    e.maxSum = std::max(e.maxSum, sum);
+    e.minDiff = std::min(e.minDiff, diff);
+    e.maxDiff = std::max(e.maxDiff, diff);
   }
-  return max_dist / 2;
+  return e;
 }
 
-Point center(const std::vector<Point> &sinks, double r) {
-  if (sinks.empty()) {
+double radius(const PointExtents &e) {
+  return std::max(e.maxSum - e.minSum, e.maxDiff - e.minDiff) / 2;
+}
+
+double radius(const std::vector<Point> &sinks) {
+  return radius(pointExtents(sinks.data(), sinks.data() + sinks.size()));
+}
+
+// Midpoint of the bounding box of count points, rounded to the grid
+Point center(const PointExtents &e, size_t count) {
+  if (count == 0) {
     return {0, 0};
   }
 
-  if (sinks.size() == 1) {
-    return {sinks[0].x, sinks[0].y};
+  if (count == 1) {
+    return {e.minX, e.minY};
   }
 
   // For multiple sinks, find the actual midpoint between them
-  int min_x = sinks[0].x, max_x = sinks[0].x;
-  int min_y = sinks[0].y, max_y = sinks[0].y;
-
-  for (const auto &sink : sinks) {
-    min_x = std::min(min_x, (int)sink.x);
-    max_x = std::max(max_x, (int)sink.x);
-    min_y = std::min(min_y, (int)sink.y);
-    max_y = std::max(max_y, (int)sink.y);
-  }
+  int min_x = e.minX, max_x = e.maxX;
+  int min_y = e.minY, max_y = e.maxY;
 
   // Calculate the midpoint
   double midpoint_x = (min_x + max_x) / 2.0;
@@ -56,122 +85,104 @@ Point center(const std::vector<Point> &sinks, double r) {
   return {round(midpoint_x), round(midpoint_y)};
 }
 
-void linear_planar_dme_sub(std::vector<Point> &S_prime, const Point &P_S_prime,
-                           std::vector<Point> &tree_points) {
-  if (S_prime.size() == 1)
-    return;
-  // cout<<"DME SUB"<<endl;
-  double r_prime = radius(S_prime);
-  Point ms_v = center(S_prime, r_prime);
-  ms_v = roundCoordinates(ms_v);
-  // Add node v at ms_v to the tree
-  tree_points.push_back(ms_v);
-  // Divide S' into S1' and S2'
-  std::vector<Point> S1_prime, S2_prime;
-
-  bool identicalPoints = true; // Flag to detect identical points condition
-  // Detect if all points are identical
-  Point firstSink = S_prime.front();
-  for (const auto &sink : S_prime) {
-    if (sink.x != firstSink.x || sink.y != firstSink.y) {
-      identicalPoints = false;
-      break;
-    }
-  }
+Point center(const std::vector<Point> &sinks, double r) {
+  return center(pointExtents(sinks.data(), sinks.data() + sinks.size()),
+                sinks.size());
+}
 
-  if (identicalPoints) {
-    // Handle identical points by creating two arbitrary groups
-    // Arbitrarily choose the half for the partitioning
-    S1_prime.assign(S_prime.begin(), S_prime.begin() + S_prime.size() / 2);
-    S2_prime.assign(S_prime.begin() + S_prime.size() / 2, S_prime.end());
-  } else {
-    for (auto &sink : S_prime) {
-      if (sink.x <= ms_v.x) {
-        S1_prime.push_back(sink);
-      } else if (sink.x > ms_v.x) {
-        S2_prime.push_back(sink);
-      }
+// Works on points[begin, end) in place: each step reorders its range so
+// that S1' precedes S2' (both keeping their relative order), no per level
+// vector copies. The ranges still to divide are kept on an explicit stack,
+// S1' on top, so points are added in the order recursion would add them
+// and no input can overflow the call stack
+void linear_planar_dme_sub(std::vector<Point> &points, size_t begin,
+                           size_t end, const Point &P_S_prime,
+                           std::vector<Point> &tree_points) {
+  std::vector<std::pair<size_t, size_t>> ranges = {{begin, end}};
+  while (!ranges.empty()) {
+    std::tie(begin, end) = ranges.back();
+    ranges.pop_back();
+    if (end - begin <= 1)
+      continue;
+    // cout<<"DME SUB"<<endl;
+    Point *first = points.data() + begin;
+    Point *last = points.data() + end;
+    PointExtents e = pointExtents(first, last);
+    Point ms_v = center(e, end - begin);
+    ms_v = roundCoordinates(ms_v);
+    // Add node v at ms_v to the tree
+    tree_points.push_back(ms_v);
+    if (logEnabled(LOG_LEVEL_TRACE)) {
+      print_points("DME Sinks S'", first, last);
     }
 
-    // Attempt split by y-coordinate if x-coordinate doesn't work
-    if (S1_prime.empty() || S2_prime.empty()) {
-      S1_prime.clear();
-      S2_prime.clear();
-      for (auto &sink : S_prime) {
-        if (sink.y <= ms_v.y) {
-          S1_prime.push_back(sink);
-        } else if (sink.y > ms_v.y) {
-          S2_prime.push_back(sink);
-        }
-      }
-    }
-  }
-  if (S1_prime.empty() || S2_prime.empty()) {
-    S1_prime.clear();
-    S2_prime.clear();
-    // First try diagonal-based partitioning
-    double diagonal_threshold = ms_v.x + ms_v.y;
-    for (const auto &sink : S_prime) {
-      if (sink.x + sink.y <= diagonal_threshold) {
-        S1_prime.push_back(sink);
+    // Divide S' into S1' = [first, mid) and S2' = [mid, last)
+    Point *mid = nullptr;
+    if (e.minX == e.maxX && e.minY == e.maxY) {
+      // Handle identical points by creating two arbitrary groups
+      // Arbitrarily choose the half for the partitioning
+      mid = first + (end - begin) / 2;
+    } else if (e.minX <= ms_v.x && e.maxX > ms_v.x) {
+      mid = std::stable_partition(
+          first, last, [&](const Point &p) { return p.x <= ms_v.x; });
+    } else if (e.minY <= ms_v.y && e.maxY > ms_v.y) {
+      // Attempt split by y-coordinate if x-coordinate doesn't work
+      mid = std::stable_partition(
+          first, last, [&](const Point &p) { return p.y <= ms_v.y; });
+    } else if (e.minSum <= ms_v.x + ms_v.y && e.maxSum > ms_v.x + ms_v.y) {
+      // Then try diagonal-based partitioning
+      double diagonal_threshold = ms_v.x + ms_v.y;
+      mid = std::stable_partition(first, last, [&](const Point &p) {
+        return p.x + p.y <= diagonal_threshold;
+      });
+    } else {
+      // If diagonal partitioning fails, use quadrant-based approach
+      auto sameQuadrant = [&](const Point &p) {
+        return (p.x <= ms_v.x && p.y <= ms_v.y) ||
+               (p.x > ms_v.x && p.y > ms_v.y);
+      };
+      size_t inS1 = std::count_if(first, last, sameQuadrant);
+      if (inS1 > 0 && inS1 < end - begin) {
+        mid = std::stable_partition(first, last, sameQuadrant);
       } else {
-        S2_prime.push_back(sink);
+        // Final fallback: force even split based on x+y coordinates
+        std::sort(first, last, [](const Point &a, const Point &b) {
+          return (a.x + a.y) < (b.x + b.y);
+        });
+        mid = first + (end - begin) / 2;
       }
     }
-    // If diagonal partitioning fails, use quadrant-based approach
-    if (S1_prime.empty() || S2_prime.empty()) {
-      S1_prime.clear();
-      S2_prime.clear();
-
-      // Determine quadrants relative to merging point
-      for (const auto &sink : S_prime) {
-        if ((sink.x <= ms_v.x && sink.y <= ms_v.y) ||
-            (sink.x > ms_v.x && sink.y > ms_v.y)) {
-          S1_prime.push_back(sink);
-        } else {
-          S2_prime.push_back(sink);
-        }
-      }
-      // Final fallback: force even split based on x+y coordinates
-      if (S1_prime.empty() || S2_prime.empty()) {
-        std::vector<Point> sorted_points = S_prime;
-        std::sort(sorted_points.begin(), sorted_points.end(),
-                  [](const Point &a, const Point &b) {
-                    return (a.x + a.y) < (b.x + b.y);
-                  });
-
-        S1_prime.clear();
-        S2_prime.clear();
-
-        size_t mid = sorted_points.size() / 2;
-        S1_prime.assign(sorted_points.begin(), sorted_points.begin() + mid);
-        S2_prime.assign(sorted_points.begin() + mid, sorted_points.end());
-      }
+    if (logEnabled(LOG_LEVEL_TRACE)) {
+      print_points("DME Sinks S1'", first, mid);
+      print_points("DME Sinks S2'", mid, last);
     }
+    LOG_TRACE("DME Merging point: (" << ms_v.x << ", " << ms_v.y << ")");
+    // S2' is divided after everything S1' adds
+    size_t split_at = begin + (mid - first);
+    ranges.push_back({split_at, end});
+    ranges.push_back({begin, split_at});
   }
-  print_points("DME Sinks S'", S_prime);
-  print_points("DME Sinks S1'", S1_prime);
-  print_points("DME Sinks S2'", S2_prime);
-  cout << "DME Merging point: (" << ms_v.x << ", " << ms_v.y << ")" << endl;
-  // Recursive calls
-  linear_planar_dme_sub(S1_prime, ms_v, tree_points);
-  linear_planar_dme_sub(S2_prime, ms_v, tree_points);
 }
 
 std::vector<Point> linear_planar_dme(std::vector<Point> &sinks,
                                      const Point &clk_location = {-1, -1}) {
-  cout << "clock location dme: (" << clk_location.x << ", " << clk_location.y
-       << ")" << endl;
-  double r = radius(sinks);
-  cout << " " << endl;
+  LOG_TRACE("clock location dme: (" << clk_location.x << ", " << clk_location.y
+            << ")");
+  LOG_TRACE(" ");
+  // No candidate survived the callers' filters, there is nothing to embed
+  // and the merging points stay where they are
+  if (sinks.empty()) {
+    return {};
+  }
   // Build Manhattan Disks
-  Point c_S = center(sinks, r);
+  PointExtents e = pointExtents(sinks.data(), sinks.data() + sinks.size());
+  Point c_S = center(e, sinks.size());
   // Print the input sinks
-  std::cout << "DME Input Sinks:" << std::endl;
+  LOG_TRACE("DME Input Sinks:");
   for (const auto &sink : sinks) {
-    std::cout << "(" << sink.x << ", " << sink.y << ")" << std::endl;
+    LOG_TRACE("(" << sink.x << ", " << sink.y << ")");
   }
-  cout << " " << endl;
+  LOG_TRACE(" ");
   // Container for tree points
   std::vector<Point> tree_points;
 
@@ -182,7 +193,7 @@ std::vector<Point> linear_planar_dme(std::vector<Point> &sinks,
   // tree_points.push_back(start_point);
   tree_points.push_back(roundCoordinates(start_point));
   // Recursive DME Sub
-  linear_planar_dme_sub(sinks, c_S, tree_points);
+  linear_planar_dme_sub(sinks, 0, sinks.size(), c_S, tree_points);
 
   // Round all points in tree_points
   for (auto &point : tree_points) {
@@ -192,39 +203,44 @@ std::vector<Point> linear_planar_dme(std::vector<Point> &sinks,
   return tree_points;
 }
 
-double ZeroSkewMerge(Node *root, int id1, int id2) {
-  // Use global variables for resistance and capacitance per unit length
-  const double resistancePerUnitLength = wireUnits.resistance;
-  const double capacitancePerUnitLength = wireUnits.capacitance;
-  Node *parent = findLCA(root, id1, id2);
-  cout << "Parent: " << parent->id << endl;
-  Node *node1 = findNodeById(root, id1);
-  Node *node2 = findNodeById(root, id2);
-  // double delaySegment1 =
-  //    getNodeDelay(root, parent->id) - getNodeDelay(root, id1);
-  // double delaySegment2 =
-  //    getNodeDelay(root, parent->id) - getNodeDelay(root, id2);
-  double delaySegment1 = getNodeDelay(root, id1);
-  double delaySegment2 = getNodeDelay(root, id2);
+// Merges the subtrees of nodes id1 and id2 under root, keeping merging
+// points off the leaves in occupancy, the index of root's tree. A node that
+// gets a buffer is added to bufferedNodes when given
+double ZeroSkewMerge(SynthesisContext &ctx, const LeafOccupancy &occupancy,
+                     Node *root, int id1, int id2,
+                     vector<Node *> *bufferedNodes = nullptr) {
+  // Resistance and capacitance per unit length of the design
+  const double resistancePerUnitLength = ctx.wireUnits.resistance;
+  const double capacitancePerUnitLength = ctx.wireUnits.capacitance;
+  // Operands come from the id index and parent links instead of searching
+  // the tree
+  Node *node1 = lookupNode(ctx, id1);
+  Node *node2 = lookupNode(ctx, id2);
+  Node *parent = findLCA(root, node1, node2);
+  LOG_TRACE("Parent: " << parent->id);
+  // double delaySegment1 = parent->elmoreDelay - node1->elmoreDelay;
+  // double delaySegment2 = parent->elmoreDelay - node2->elmoreDelay;
+  double delaySegment1 = node1->elmoreDelay;
+  double delaySegment2 = node2->elmoreDelay;
   // cout << delaySegment1 << endl;
   // cout << delaySegment2 << endl;
-  double capacitanceSegment1 = getNodeCapacitance(root, id1);
-  cout << "CapSeg1: " << capacitanceSegment1 << endl;
-  double capacitanceSegment2 = getNodeCapacitance(root, id2);
-  cout << "CapSeg2: " << capacitanceSegment2 << endl;
-  int lengthOfWire = calculateManhattanDistance(root, id1, id2);
+  double capacitanceSegment1 = node1->capacitance;
+  LOG_TRACE("CapSeg1: " << capacitanceSegment1);
+  double capacitanceSegment2 = node2->capacitance;
+  LOG_TRACE("CapSeg2: " << capacitanceSegment2);
+  int lengthOfWire = calculateManhattanDistance(node1, node2);
   double delayDifference = abs(delaySegment1 - delaySegment2);
   int sink1_distance, sink2_distance;
-  cout << endl;
+  LOG_TRACE("");
   double x1 = node1->x;
   double y1 = node1->y;
   double x2 = node2->x;
   double y2 = node2->y;
-  cout << "x1: " << x1 << endl;
-  cout << "y1: " << y1 << endl;
-  cout << "x2: " << x2 << endl;
-  cout << "y2: " << y2 << endl;
-  cout << endl;
+  LOG_TRACE("x1: " << x1);
+  LOG_TRACE("y1: " << y1);
+  LOG_TRACE("x2: " << x2);
+  LOG_TRACE("y2: " << y2);
+  LOG_TRACE("");
   // Calculate the initial merging point x
   double numerator =
       (delaySegment2 - delaySegment1) +
@@ -247,37 +263,38 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
   }
 
   if (mergingPointX >= 0 && mergingPointX <= 1) {
-    cout << "Tapping point in range, calculating merging point X: "
-         << mergingPointX << endl;
-    cout << "length of wire: " << lengthOfWire << endl;
-    cout << "merge point distance for sink 1 :" << sink1_distance << endl;
-    cout << "merge point distance for sink 2 :" << sink2_distance << endl;
+    ctx.metrics.add(Counter::MergesInRange);
+    LOG_TRACE("Tapping point in range, calculating merging point X: "
+              << mergingPointX);
+    LOG_TRACE("length of wire: " << lengthOfWire);
+    LOG_TRACE("merge point distance for sink 1 :" << sink1_distance);
+    LOG_TRACE("merge point distance for sink 2 :" << sink2_distance);
     vector<Point> points1 = findPoints(x1, y1, sink1_distance);
     vector<Point> points2 = findPoints(x2, y2, sink2_distance);
-    cout << endl;
-    cout << "All solutions for point 1 are:\n";
+    LOG_TRACE("");
+    LOG_TRACE("All solutions for point 1 are:");
     for (const Point &point : points1) {
-      cout << "(" << point.x << ", " << point.y << ")\n";
+      LOG_TRACE("(" << point.x << ", " << point.y << ")");
     }
-    cout << endl;
+    LOG_TRACE("");
 
-    cout << "All solutions for point 2 are:\n";
+    LOG_TRACE("All solutions for point 2 are:");
     for (const Point &point : points2) {
-      cout << "(" << point.x << ", " << point.y << ")\n";
+      LOG_TRACE("(" << point.x << ", " << point.y << ")");
     }
-    cout << endl;
+    LOG_TRACE("");
     vector<Point> solutions1, solutions2;
-    cout << "Valid solutions for point 1 are:\n";
+    LOG_TRACE("Valid solutions for point 1 are:");
     for (const Point &point : points1) {
       if (point.x == x1 && point.x >= 0 && point.y >= 0) {
         solutions1.push_back(point);
       }
     }
     for (const Point &point : solutions1) {
-      cout << "(" << point.x << ", " << point.y << ")\n";
+      LOG_TRACE("(" << point.x << ", " << point.y << ")");
     }
-    cout << endl;
-    cout << "Valid solutions for point 2 are:\n";
+    LOG_TRACE("");
+    LOG_TRACE("Valid solutions for point 2 are:");
     for (const Point &point : points2) {
       if (point.x == x2 && point.x >= 0 && point.y >= 0) {
         solutions2.push_back(point);
@@ -285,7 +302,7 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
     }
 
     for (const Point &point : solutions2) {
-      cout << "(" << point.x << ", " << point.y << ")\n";
+      LOG_TRACE("(" << point.x << ", " << point.y << ")");
     }
 
     // test
@@ -296,26 +313,20 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
     // Call linear_planar_dme and get all merging points
     vector<Point> mergingPoints = linear_planar_dme(solutions);
 
-    // Find the parent node and its ancestors
-    Node *parent = findLCA(root, id1, id2);
-    vector<Node *> ancestors;
-    Node *current = parent;
-    while (current != nullptr) {
-      ancestors.push_back(current);
-      current = findLCA(root, current->id, root->id);
-      if (current == root)
-        break;
-    }
+    // Only the parent takes a merging point: the walk up its ancestors that
+    // was here stepped with findLCA(root, node, root), which is root, so it
+    // always ended after the parent
+    vector<Node *> ancestors = {parent};
 
     // Assign merging points to parent and ancestors
     for (size_t i = 0; i < min(mergingPoints.size(), ancestors.size()); ++i) {
       Point roundedPoint = roundCoordinates(mergingPoints[i]);
       // Find nearest free point
-      Point freePoint = findNearestFreePoint(root, roundedPoint);
+      Point freePoint = findNearestFreePoint(occupancy, root, roundedPoint);
       ancestors[i]->x = freePoint.x;
       ancestors[i]->y = freePoint.y;
       ancestors[i]->z = node1->z;
-      ancestors[i]->node_type = "Merging Point";
+      ancestors[i]->node_type = NodeType::MergingPoint;
     }
 
     return mergingPointX *
@@ -327,8 +338,8 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
     int extension = 0;
     if (mergingPointX > 1) {
       // For x > 1, tapping point exactly on subtree 2
-      cout << "Tapping point out of range( > 1), extending from Subtree 2"
-           << endl;
+      ctx.metrics.add(Counter::MergesExtendRight);
+      LOG_TRACE("Tapping point out of range( > 1), extending from Subtree 2");
       lPrime = (sqrt(pow(resistancePerUnitLength * capacitanceSegment1, 2) +
                      2 * resistancePerUnitLength * capacitancePerUnitLength *
                          (delaySegment2 - delaySegment1)) -
@@ -339,16 +350,20 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
       double totalLength = lengthOfWire + extension;
       // Check if buffer is needed (1.5x threshold)
       if (totalLength > (lengthOfWire * 1.5)) {
-        cout << "Adding buffer at merging point due to extended length: "
-             << totalLength << " (original: " << lengthOfWire << ")" << endl;
+        LOG_TRACE("Adding buffer at merging point due to extended length: "
+                  << totalLength << " (original: " << lengthOfWire << ")");
 
         // Calculate required buffer delay to equalize delays
         double requiredBufferDelay = delayDifference;
         // Update parent node to include buffer
         // parent->isBuffered = true;
         parent->bufferDelay = requiredBufferDelay;
-        parent->resistance = bufferUnits.outputResistance;
-        parent->capacitance = bufferUnits.inputCapacitance;
+        parent->resistance = ctx.bufferUnits.outputResistance;
+        parent->capacitance = ctx.bufferUnits.inputCapacitance;
+        if (bufferedNodes) {
+          bufferedNodes->push_back(parent);
+        }
+        ctx.metrics.add(Counter::BufferInsertions);
         //  Add buffer delay to the path
         // parent->elmoreDelay = requiredBufferDelay;
         // parent->elmoreDelay += bufferUnits.intrinsicDelay;
@@ -357,54 +372,49 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
         // delaySegment2 = getNodeDelay(root, parent->id);
         extension = 0;
         lPrime = lengthOfWire;
-        cout << "Buffer with delay " << requiredBufferDelay
-             << "fs inserted at merging point, length will not be extended"
-             << endl;
+        LOG_TRACE(
+            "Buffer with delay "
+            << requiredBufferDelay
+            << "fs inserted at merging point, length will not be extended");
       }
-      cout << "lPrime rounded = " << round(lPrime) << endl;
-      cout << "Extending L from " << lengthOfWire << " to "
-           << extension + lengthOfWire << endl;
+      LOG_TRACE("lPrime rounded = " << round(lPrime));
+      LOG_TRACE("Extending L from " << lengthOfWire << " to "
+                << extension + lengthOfWire);
       vector<Point> points = findPoints(x2, y2, (extension + lengthOfWire));
-      cout << endl;
-      cout << "Unique points satisfying the equation are:\n";
+      LOG_TRACE("");
+      LOG_TRACE("Unique points satisfying the equation are:");
       for (const Point &point : points) {
-        cout << "(" << point.x << ", " << point.y << ")\n";
+        LOG_TRACE("(" << point.x << ", " << point.y << ")");
       }
-      cout << endl;
-      cout << "Valid solution(s) rooted at subtree 2 are:\n";
+      LOG_TRACE("");
+      LOG_TRACE("Valid solution(s) rooted at subtree 2 are:");
       for (const Point &point : points) {
         if (point.x == x2 && point.x >= 0 && point.y >= 0 &&
-            point.x <= layout.width && point.y <= layout.height) {
+            point.x <= ctx.layout.width && point.y <= ctx.layout.height) {
           // if (point.x == x2 && point.x >= 0 && point.y >= 0) {
           solutions.push_back(point);
         }
       }
       for (const Point &point : solutions) {
-        cout << "(" << point.x << ", " << point.y << ")\n";
+        LOG_TRACE("(" << point.x << ", " << point.y << ")");
       }
       // Call linear_planar_dme and get all merging points
       vector<Point> mergingPoints = linear_planar_dme(solutions);
 
-      // Find the parent node and its ancestors
-      Node *parent = findLCA(root, id1, id2);
-      vector<Node *> ancestors;
-      Node *current = parent;
-      while (current != nullptr) {
-        ancestors.push_back(current);
-        current = findLCA(root, current->id, root->id);
-        if (current == root)
-          break;
-      }
+      // Only the parent takes a merging point: the walk up its ancestors that
+      // was here stepped with findLCA(root, node, root), which is root, so it
+      // always ended after the parent
+      vector<Node *> ancestors = {parent};
 
       // Assign merging points to parent and ancestors
       for (size_t i = 0; i < min(mergingPoints.size(), ancestors.size()); ++i) {
         Point roundedPoint = roundCoordinates(mergingPoints[i]);
         // Find nearest free point
-        Point freePoint = findNearestFreePoint(root, roundedPoint);
+        Point freePoint = findNearestFreePoint(occupancy, root, roundedPoint);
         ancestors[i]->x = freePoint.x;
         ancestors[i]->y = freePoint.y;
         ancestors[i]->z = node1->z;
-        ancestors[i]->node_type = "Merging Point";
+        ancestors[i]->node_type = NodeType::MergingPoint;
       }
 
     } else {
@@ -412,8 +422,8 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
       double lPrime = 0;
       int extension = 0;
       // For x < 0, tapping point on root of subtree 1
-      cout << "Tapping point out of range( < 0), extending from Subtree 1"
-           << endl;
+      ctx.metrics.add(Counter::MergesExtendLeft);
+      LOG_TRACE("Tapping point out of range( < 0), extending from Subtree 1");
       lPrime = (sqrt(pow(resistancePerUnitLength * capacitanceSegment2, 2) +
                      2 * resistancePerUnitLength * capacitancePerUnitLength *
                          (delaySegment1 - delaySegment2)) -
@@ -424,16 +434,20 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
       double totalLength = lengthOfWire + extension;
       // Check if buffer is needed (1.5x threshold)
       if (totalLength > (lengthOfWire * 1.5)) {
-        cout << "Adding buffer at merging point due to extended length: "
-             << totalLength << " (original: " << lengthOfWire << ")" << endl;
+        LOG_TRACE("Adding buffer at merging point due to extended length: "
+                  << totalLength << " (original: " << lengthOfWire << ")");
 
         // Calculate required buffer delay to equalize delays
         double requiredBufferDelay = delayDifference;
         // Update parent node to include buffer
         // parent->isBuffered = true;
         parent->bufferDelay = requiredBufferDelay;
-        parent->resistance = bufferUnits.outputResistance;
-        parent->capacitance = bufferUnits.inputCapacitance;
+        parent->resistance = ctx.bufferUnits.outputResistance;
+        parent->capacitance = ctx.bufferUnits.inputCapacitance;
+        if (bufferedNodes) {
+          bufferedNodes->push_back(parent);
+        }
+        ctx.metrics.add(Counter::BufferInsertions);
         //  Add buffer delay to the path
         // parent->elmoreDelay = requiredBufferDelay;
         // parent->elmoreDelay += bufferUnits.intrinsicDelay;
@@ -442,76 +456,124 @@ double ZeroSkewMerge(Node *root, int id1, int id2) {
         // delaySegment2 = getNodeDelay(root, parent->id);
         extension = 0;
         lPrime = lengthOfWire;
-        cout << "Buffer with delay " << requiredBufferDelay
-             << "fs inserted at merging point, length will not be extended"
-             << endl;
+        LOG_TRACE(
+            "Buffer with delay "
+            << requiredBufferDelay
+            << "fs inserted at merging point, length will not be extended");
       }
-      cout << "lPrime rounded = " << round(lPrime) << endl;
-      cout << "L from " << lengthOfWire << " to " << extension + lengthOfWire
-           << endl;
+      LOG_TRACE("lPrime rounded = " << round(lPrime));
+      LOG_TRACE("L from " << lengthOfWire << " to "
+                << extension + lengthOfWire);
       vector<Point> points = findPoints(x1, y1, extension + lengthOfWire);
-      cout << endl;
-      cout << "Unique points satisfying the equation are:\n";
+      LOG_TRACE("");
+      LOG_TRACE("Unique points satisfying the equation are:");
       for (const Point &point : points) {
-        cout << "(" << point.x << ", " << point.y << ")\n";
+        LOG_TRACE("(" << point.x << ", " << point.y << ")");
       }
-      cout << endl;
-      cout << "Valid solution(s) rooted at subtree 1 are:\n";
+      LOG_TRACE("");
+      LOG_TRACE("Valid solution(s) rooted at subtree 1 are:");
       for (const Point &point : points) {
         if (point.x == x1 && point.x >= 0 && point.y >= 0 &&
-            point.x <= layout.width && point.y <= layout.height) {
+            point.x <= ctx.layout.width && point.y <= ctx.layout.height) {
           // if (point.x == x1 && point.x >= 0 && point.y >= 0) {
           solutions.push_back(point);
         }
       }
       for (const Point &point : solutions) {
-        cout << "(" << point.x << ", " << point.y << ")\n";
+        LOG_TRACE("(" << point.x << ", " << point.y << ")");
       }
 
       // Call linear_planar_dme and get all merging points
       vector<Point> mergingPoints = linear_planar_dme(solutions);
 
-      // Find the parent node and its ancestors
-      Node *parent = findLCA(root, id1, id2);
-      vector<Node *> ancestors;
-      Node *current = parent;
-      while (current != nullptr) {
-        ancestors.push_back(current);
-        current = findLCA(root, current->id, root->id);
-        if (current == root)
-          break;
-      }
+      // Only the parent takes a merging point: the walk up its ancestors that
+      // was here stepped with findLCA(root, node, root), which is root, so it
+      // always ended after the parent
+      vector<Node *> ancestors = {parent};
 
       // Assign merging points to parent and ancestors
       for (size_t i = 0; i < min(mergingPoints.size(), ancestors.size()); ++i) {
         Point roundedPoint = roundCoordinates(mergingPoints[i]);
         // Find nearest free point
-        Point freePoint = findNearestFreePoint(root, roundedPoint);
+        Point freePoint = findNearestFreePoint(occupancy, root, roundedPoint);
         ancestors[i]->x = freePoint.x;
         ancestors[i]->y = freePoint.y;
         ancestors[i]->z = node1->z;
-        ancestors[i]->node_type = "Merging Point";
+        ancestors[i]->node_type = NodeType::MergingPoint;
       }
     }
-    cout << endl;
+    LOG_TRACE("");
     return lPrime;
   }
 }
-// // Main recursive function to perform zero skew merging
-Node *zeroSkewTree(Node *root) {
+// Subtrees with fewer sinks than this are merged on the thread that
+// reached them
+const size_t zeroSkewParallelGrain = 1024;
+
+// Main recursive function to perform zero skew merging. A merge only
+// reads its two children and writes its own node, so the two subtrees of a
+// large node are merged on two threads while budget allows. Each logs into
+// its own buffer and collects its own buffered nodes, so the log and the
+// list read as in a serial run
+Node *zeroSkewTreeSub(SynthesisContext &ctx, const LeafOccupancy &occupancy,
+                      Node *root, vector<Node *> &bufferedNodes,
+                      unsigned budget = 1) {
   if (!root || (root->leftChild == nullptr && root->rightChild == nullptr)) {
     return root;
   }
 
-  root->leftChild = zeroSkewTree(root->leftChild);
-  root->rightChild = zeroSkewTree(root->rightChild);
+  if (budget > 1 && root->sinks.size() >= zeroSkewParallelGrain) {
+    ostringstream leftLog, rightLog;
+    vector<Node *> rightBuffered;
+    forkJoin(
+        budget,
+        [&](unsigned share) {
+          ThreadLogScope log(leftLog);
+          root->leftChild = zeroSkewTreeSub(ctx, occupancy, root->leftChild,
+                                            bufferedNodes, share);
+        },
+        [&](unsigned share) {
+          ThreadLogScope log(rightLog);
+          root->rightChild = zeroSkewTreeSub(ctx, occupancy, root->rightChild,
+                                             rightBuffered, share);
+        });
+    logStream() << leftLog.str() << rightLog.str();
+    bufferedNodes.insert(bufferedNodes.end(), rightBuffered.begin(),
+                         rightBuffered.end());
+  } else {
+    root->leftChild =
+        zeroSkewTreeSub(ctx, occupancy, root->leftChild, bufferedNodes);
+    root->rightChild =
+        zeroSkewTreeSub(ctx, occupancy, root->rightChild, bufferedNodes);
+  }
 
   if (hasPhysicalLocation(root->leftChild) &&
       hasPhysicalLocation(root->rightChild)) {
-    ZeroSkewMerge(root, root->leftChild->id, root->rightChild->id);
-    ZeroSkewMerges++;
-    cout << "Merged At: (" << root->x << ", " << root->y << ")" << endl;
-    cout << "ZeroSkewMerges: " << ZeroSkewMerges << endl;
+    ZeroSkewMerge(ctx, occupancy, root, root->leftChild->id,
+                  root->rightChild->id, &bufferedNodes);
+    ctx.metrics.add(Counter::ZeroSkewMerges);
+    LOG_TRACE("Merged At: (" << root->x << ", " << root->y << ")");
+    LOG_TRACE("ZeroSkewMerges: "
+              << ctx.metrics.value(Counter::ZeroSkewMerges));
   }
   return root;
-}
\ No newline at end of file
+}
+
+// Merges a whole abstract tree bottom up. Sibling subtrees of large trees
+// are merged in parallel on up to ctx.threads threads, with the same merges
+// and buffer decisions as a serial run. Nodes that get a buffer are added
+// to bufferedNodes when given, for retimeBufferedNodes
+Node *zeroSkewTree(SynthesisContext &ctx, Node *root,
+                   vector<Node *> *bufferedNodes = nullptr) {
+  // Leaves do not move while merging, index them once for the whole tree
+  LeafOccupancy occupancy;
+  buildLeafOccupancy(occupancy, root);
+  vector<Node *> buffered;
+  Node *merged = zeroSkewTreeSub(ctx, occupancy, root, buffered,
+                                 availableThreads(ctx.threads));
+  if (bufferedNodes) {
+    bufferedNodes->insert(bufferedNodes->end(), buffered.begin(),
+                          buffered.end());
+  }
+  return merged;
+}
@@ -0,0 +1,751 @@
+#pragma once
+#include "clustering.hpp"
+#include "context.hpp"
+#include "logging.hpp"
+#include "structures.hpp"
+#include "synthesis.hpp"
+#include "trace.hpp"
+#include "tree.hpp"
+#include "utilities.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Engineering change orders: add, remove or move a few sinks of a design a
+// previous run synthesized. The DBSCAN clusters of every tier are kept, a
+// changed sink only resynthesizes the cluster it is in, and a cluster whose
+// root changed hands its new MIV sink to the cluster holding it in the tier
+// above, which is resynthesized in turn. Only the export files of tiers
+// with a resynthesized cluster are rewritten, and only their ideal (MST)
+// wirelengths are recomputed.
+//
+// A resynthesized cluster is built again from all of its sinks, nothing of
+// its old subtree is reused. The work saved is that of the clusters left
+// alone, so with one cluster per tier, as the default eps gives, any change
+// resynthesizes every tier it reaches. The design state file and the
+// export files of the tiers touched are read and written whole
+
+string designStateFilename(const SynthesisContext &ctx) {
+  return ctx.outputPrefix + "design_state.txt";
+}
+
+string tierExportFilename(const SynthesisContext &ctx, int z) {
+  return ctx.outputPrefix + "zeroskew_points_and_lines_z_" + to_string(z) +
+         ".txt";
+}
+
+string tierDBSCANFilename(const SynthesisContext &ctx, int z) {
+  return ctx.outputPrefix + "dbscan_results_z_" + to_string(z) + ".csv";
+}
+
+// Design state file. Doubles are written with enough digits to read back
+// exactly, so a resynthesized cluster comes out as it would have in the run
+// that wrote the file. The subtree blocks stay in the tier export files
+const string designStateHeader = "mmm-design-state 2";
+
+unsigned long long mixFingerprint(unsigned long long hash,
+                                  unsigned long long value) {
+  // splitmix64 finalizer over the running hash and the value
+  hash = (hash ^ value) + 0x9e3779b97f4a7c15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+unsigned long long mixFingerprint(unsigned long long hash, int value) {
+  return mixFingerprint(hash, (unsigned long long)(unsigned)value);
+}
+
+unsigned long long mixFingerprint(unsigned long long hash, double value) {
+  unsigned long long bits;
+  memcpy(&bits, &value, sizeof bits);
+  return mixFingerprint(hash, bits);
+}
+
+// Fingerprint of the design a run read: its parameters and its sinks. The
+// sinks are summed in any order, so a sink database gives the fingerprint
+// of the text benchmark it was converted from. An ECO synthesizes with the
+// parameters of the design it is given, which must be the one the state
+// was saved from
+unsigned long long designFingerprint(const SynthesisContext &ctx) {
+  unsigned long long hash = 0;
+  hash = mixFingerprint(hash, ctx.layout.width);
+  hash = mixFingerprint(hash, ctx.layout.height);
+  hash = mixFingerprint(hash, ctx.layout.numDies);
+  hash = mixFingerprint(hash, ctx.wireUnits.resistance);
+  hash = mixFingerprint(hash, ctx.wireUnits.capacitance);
+  hash = mixFingerprint(hash, ctx.bufferUnits.outputResistance);
+  hash = mixFingerprint(hash, ctx.bufferUnits.inputCapacitance);
+  hash = mixFingerprint(hash, ctx.bufferUnits.intrinsicDelay);
+  hash = mixFingerprint(hash, ctx.tsvUnits.resistance);
+  hash = mixFingerprint(hash, ctx.tsvUnits.capacitance);
+  hash = mixFingerprint(hash, ctx.clockSource.x);
+  hash = mixFingerprint(hash, ctx.clockSource.y);
+  hash = mixFingerprint(hash, ctx.clockSource.z);
+  hash = mixFingerprint(hash, ctx.clockSource.outputResistance);
+  const Sink *first =
+      ctx.sinkDatabase ? ctx.databaseSinks.begin() : ctx.sinks.data();
+  const Sink *last = ctx.sinkDatabase ? ctx.databaseSinks.end()
+                                      : ctx.sinks.data() + ctx.sinks.size();
+  unsigned long long sinkSum = 0;
+  for (const Sink *sink = first; sink != last; ++sink) {
+    unsigned long long sinkHash = mixFingerprint(0, sink->x);
+    sinkHash = mixFingerprint(sinkHash, sink->y);
+    sinkHash = mixFingerprint(sinkHash, sink->z);
+    sinkSum += mixFingerprint(sinkHash, sink->inputCapacitance);
+  }
+  hash = mixFingerprint(hash, (unsigned long long)(last - first));
+  return mixFingerprint(hash, sinkSum);
+}
+
+void writeStateSink(ostream &out, const Sink &sink) {
+  out << sink.x << ' ' << sink.y << ' ' << sink.z << ' '
+      << sink.inputCapacitance << ' ' << sink.capacitance << ' ' << sink.delay
+      << ' ' << sink.cluster_id << ' ' << (int)sink.dieIndex << ' '
+      << (int)sink.sink_type << '\n';
+}
+
+void saveDesignState(const SynthesisContext &ctx, const DesignState &design) {
+  string filename = designStateFilename(ctx);
+  ofstream out(filename);
+  if (!out.is_open()) {
+    throw runtime_error("Error opening file for writing: " + filename);
+  }
+  out << setprecision(17);
+  out << designStateHeader << '\n';
+  out << "design " << designFingerprint(ctx) << '\n';
+  out << "bound " << design.bound << '\n';
+  for (const auto &entry : design.tiers) {
+    const TierState &tier = entry.second;
+    out << "tier " << tier.z << ' ' << tier.idealWirelength << ' '
+        << tier.clusters.size() << ' ' << tier.midpoints.size() << '\n';
+    // Sorted so the file does not depend on hash order
+    map<int, pair<double, double>> midpoints(tier.midpoints.begin(),
+                                             tier.midpoints.end());
+    for (const auto &midpoint : midpoints) {
+      out << "midpoint " << midpoint.first << ' ' << midpoint.second.first
+          << ' ' << midpoint.second.second << '\n';
+    }
+    for (const ClusterState &cluster : tier.clusters) {
+      out << "cluster " << cluster.clusterId << ' ' << cluster.wirelength
+          << ' ' << cluster.sinks.size() << '\n';
+      writeStateSink(out, cluster.mivSink);
+      for (const Sink &sink : cluster.sinks) {
+        writeStateSink(out, sink);
+      }
+    }
+  }
+}
+
+// Reads the word every state record starts with
+void expectStateWord(istream &in, const string &word,
+                     const string &filename) {
+  string read;
+  if (!(in >> read) || read != word) {
+    throw runtime_error("Bad design state file " + filename + ": expected '" +
+                        word + "'");
+  }
+}
+
+Sink readStateSink(istream &in, const string &filename) {
+  Sink sink;
+  int dieIndex, sinkType;
+  if (!(in >> sink.x >> sink.y >> sink.z >> sink.inputCapacitance >>
+        sink.capacitance >> sink.delay >> sink.cluster_id >> dieIndex >>
+        sinkType)) {
+    throw runtime_error("Bad design state file " + filename + ": bad sink");
+  }
+  sink.dieIndex = (uint8_t)dieIndex;
+  sink.sink_type = (SinkType)sinkType;
+  return sink;
+}
+
+// Splits a tier export file into its subtree blocks, one per cluster that
+// still has sinks
+void loadTierExport(const SynthesisContext &ctx, TierState &tier) {
+  string filename = tierExportFilename(ctx, tier.z);
+  ifstream in(filename);
+  if (!in.is_open()) {
+    throw runtime_error("Error opening file: " + filename);
+  }
+  string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  const string separator = "\n# New Subtree\n";
+  vector<size_t> starts;
+  for (size_t at = text.find(separator); at != string::npos;
+       at = text.find(separator, at + 1)) {
+    starts.push_back(at);
+  }
+  starts.push_back(text.size());
+  size_t block = 0;
+  for (ClusterState &cluster : tier.clusters) {
+    if (cluster.sinks.empty()) {
+      continue;
+    }
+    if (block + 1 >= starts.size()) {
+      throw runtime_error(filename + " has fewer subtrees than the design");
+    }
+    cluster.exported = text.substr(starts[block], starts[block + 1] -
+                                                      starts[block]);
+    block++;
+  }
+  if (block + 1 != starts.size()) {
+    throw runtime_error(filename + " has more subtrees than the design");
+  }
+}
+
+// Reads back the design a previous run saved, with its export files
+DesignState loadDesignState(const SynthesisContext &ctx) {
+  string filename = designStateFilename(ctx);
+  ifstream in(filename);
+  if (!in.is_open()) {
+    throw runtime_error("Error opening file: " + filename);
+  }
+  string header;
+  getline(in, header);
+  if (header != designStateHeader) {
+    throw runtime_error("Bad design state file " + filename + ": header");
+  }
+  expectStateWord(in, "design", filename);
+  unsigned long long fingerprint = 0;
+  in >> fingerprint;
+  if (!in || fingerprint != designFingerprint(ctx)) {
+    throw runtime_error(filename + " was saved from another design, or one "
+                                   "with other parameters, than the one "
+                                   "given");
+  }
+  DesignState design;
+  expectStateWord(in, "bound", filename);
+  in >> design.bound;
+  string word;
+  while (in >> word) {
+    if (word != "tier") {
+      throw runtime_error("Bad design state file " + filename +
+                          ": expected 'tier'");
+    }
+    int z, idealWirelength;
+    size_t clusterCount, midpointCount;
+    in >> z >> idealWirelength >> clusterCount >> midpointCount;
+    TierState &tier = design.tiers[z];
+    tier.z = z;
+    tier.idealWirelength = idealWirelength;
+    for (size_t i = 0; i < midpointCount; i++) {
+      expectStateWord(in, "midpoint", filename);
+      int clusterId;
+      pair<double, double> midpoint;
+      in >> clusterId >> midpoint.first >> midpoint.second;
+      tier.midpoints[clusterId] = midpoint;
+    }
+    for (size_t i = 0; i < clusterCount; i++) {
+      expectStateWord(in, "cluster", filename);
+      ClusterState cluster;
+      size_t sinkCount;
+      in >> cluster.clusterId >> cluster.wirelength >> sinkCount;
+      cluster.mivSink = readStateSink(in, filename);
+      cluster.sinks.reserve(sinkCount);
+      for (size_t k = 0; k < sinkCount; k++) {
+        cluster.sinks.push_back(readStateSink(in, filename));
+      }
+      tier.clusters.push_back(std::move(cluster));
+    }
+    if (!in) {
+      throw runtime_error("Bad design state file " + filename);
+    }
+    loadTierExport(ctx, tier);
+  }
+  return design;
+}
+
+enum class SinkChangeKind : uint8_t { Add, Remove, Move };
+
+// One line of a sink delta file:
+//   add x y z capacitance
+//   remove x y z
+//   move x y z newX newY newZ
+// with // comments as in the benchmark files
+struct SinkChange {
+  SinkChangeKind kind;
+  Sink sink;          // Sink to add, or where the sink to change is
+  int toX, toY, toZ;  // Where a moved sink goes
+  int line;           // Line in the delta file, for errors
+};
+
+vector<SinkChange> readSinkChanges(const string &filename) {
+  ifstream in(filename);
+  if (!in.is_open()) {
+    throw runtime_error("Error opening file: " + filename);
+  }
+  vector<SinkChange> changes;
+  string text;
+  for (int line = 1; getline(in, text); line++) {
+    text = text.substr(0, text.find("//"));
+    istringstream fields(text);
+    string op;
+    if (!(fields >> op)) {
+      continue; // Blank or comment line
+    }
+    SinkChange change;
+    change.line = line;
+    change.toX = change.toY = change.toZ = 0;
+    Sink &sink = change.sink;
+    bool ok = false;
+    if (op == "add") {
+      change.kind = SinkChangeKind::Add;
+      ok = (bool)(fields >> sink.x >> sink.y >> sink.z >>
+                  sink.inputCapacitance);
+    } else if (op == "remove") {
+      change.kind = SinkChangeKind::Remove;
+      ok = (bool)(fields >> sink.x >> sink.y >> sink.z);
+    } else if (op == "move") {
+      change.kind = SinkChangeKind::Move;
+      ok = (bool)(fields >> sink.x >> sink.y >> sink.z >> change.toX >>
+                  change.toY >> change.toZ);
+    }
+    string extra;
+    if (!ok || fields >> extra) {
+      throw runtime_error(filename + ":" + to_string(line) +
+                          ": bad sink change '" + text + "'");
+    }
+    changes.push_back(change);
+  }
+  return changes;
+}
+
+// A sink of a tier as the ECO index sees it. The z tells the tier's own
+// sinks from the MIV sinks of the tier below
+struct SinkSlot {
+  int x, y, z;
+  int cluster; // Index into the tier's clusters
+};
+
+// Side of the square buckets the ECO index groups sinks in
+const int ecoBucketSize = 32;
+
+// Lookup structures of one tier, built when a change first touches it
+struct TierIndex {
+  unordered_map<long long, vector<SinkSlot>> buckets; // By position
+  unordered_map<int, int> mivClusterOf; // Lower cluster id -> cluster index
+  size_t sinkCount = 0;
+};
+
+// Bookkeeping of one ECO pass over a design
+struct EcoRun {
+  DesignState &design;
+  map<int, TierIndex> indices;
+  map<int, set<int>> dirty; // Per tier, clusters to resynthesize
+};
+
+int bucketCoord(int v) {
+  // Rounds down for negative coordinates too
+  return v >= 0 ? v / ecoBucketSize
+                : -((-v + ecoBucketSize - 1) / ecoBucketSize);
+}
+
+void indexSink(TierIndex &index, const Sink &sink, int cluster) {
+  long long key = cellKey(bucketCoord(sink.x), bucketCoord(sink.y));
+  index.buckets[key].push_back({sink.x, sink.y, sink.z, cluster});
+  index.sinkCount++;
+}
+
+void unindexSink(TierIndex &index, const Sink &sink, int cluster) {
+  long long key = cellKey(bucketCoord(sink.x), bucketCoord(sink.y));
+  vector<SinkSlot> &slots = index.buckets[key];
+  for (size_t i = 0; i < slots.size(); i++) {
+    const SinkSlot &slot = slots[i];
+    if (slot.x == sink.x && slot.y == sink.y && slot.z == sink.z &&
+        slot.cluster == cluster) {
+      slots.erase(slots.begin() + i);
+      index.sinkCount--;
+      return;
+    }
+  }
+}
+
+TierState &ecoTier(EcoRun &run, int z, int line) {
+  auto it = run.design.tiers.find(z);
+  if (it == run.design.tiers.end()) {
+    throw runtime_error("Sink change on line " + to_string(line) +
+                        ": the design has no tier " + to_string(z));
+  }
+  return it->second;
+}
+
+TierIndex &tierIndex(EcoRun &run, int z) {
+  auto found = run.indices.find(z);
+  if (found != run.indices.end()) {
+    return found->second;
+  }
+  TierIndex &index = run.indices[z];
+  const TierState &tier = run.design.tiers.at(z);
+  for (size_t c = 0; c < tier.clusters.size(); c++) {
+    for (const Sink &sink : tier.clusters[c].sinks) {
+      indexSink(index, sink, (int)c);
+      if (sink.sink_type == SinkType::MIV) {
+        index.mivClusterOf[sink.cluster_id] = (int)c;
+      }
+    }
+  }
+  return index;
+}
+
+// Indexed sinks at most radius away from (x, y) in x and in y
+vector<SinkSlot> sinksNear(const TierIndex &index, int x, int y, int radius) {
+  vector<SinkSlot> near;
+  for (int bx = bucketCoord(x - radius); bx <= bucketCoord(x + radius); bx++) {
+    for (int by = bucketCoord(y - radius); by <= bucketCoord(y + radius);
+         by++) {
+      auto it = index.buckets.find(cellKey(bx, by));
+      if (it == index.buckets.end())
+        continue;
+      for (const SinkSlot &slot : it->second) {
+        if (abs(slot.x - x) <= radius && abs(slot.y - y) <= radius) {
+          near.push_back(slot);
+        }
+      }
+    }
+  }
+  return near;
+}
+
+// Whether a sink of another die lies within adjustNearlyIdenticalCoords'
+// threshold of (x, y)
+bool nearOtherDie(const TierIndex &index, int x, int y, int z) {
+  for (const SinkSlot &slot : sinksNear(index, x, y, 1)) {
+    if (slot.z != z) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Offsets an MIV sink off the tier's sinks as adjustNearlyIdenticalCoords
+// does in a full run, then indexes it
+void placeMIVSink(TierIndex &index, Sink &sink, int cluster) {
+  while (nearOtherDie(index, sink.x, sink.y, sink.z)) {
+    sink.x += 1;
+    sink.y += 1;
+  }
+  indexSink(index, sink, cluster);
+}
+
+int findClusterSink(const ClusterState &cluster, int x, int y, int z) {
+  for (size_t i = 0; i < cluster.sinks.size(); i++) {
+    const Sink &sink = cluster.sinks[i];
+    if (sink.x == x && sink.y == y && sink.z == z) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+// Cluster a new sink at (x, y) joins: that of the nearest sink of the tier,
+// as DBSCAN with minPts 1 would mostly have it. Searches rings of buckets
+// outwards until no closer sink can be left
+int nearestSinkCluster(const TierIndex &index, int x, int y) {
+  int bx = bucketCoord(x), by = bucketCoord(y);
+  int nearest = -1;
+  double nearestDistance = 0;
+  size_t seen = 0;
+  for (int r = 0; seen < index.sinkCount; r++) {
+    for (int dx = -r; dx <= r; dx++) {
+      for (int dy = -r; dy <= r; dy++) {
+        if (abs(dx) != r && abs(dy) != r)
+          continue; // Inside the ring, already searched
+        auto it = index.buckets.find(cellKey(bx + dx, by + dy));
+        if (it == index.buckets.end())
+          continue;
+        for (const SinkSlot &slot : it->second) {
+          double ddx = slot.x - x, ddy = slot.y - y;
+          double distance = ddx * ddx + ddy * ddy;
+          if (nearest < 0 || distance < nearestDistance) {
+            nearest = slot.cluster;
+            nearestDistance = distance;
+          }
+          seen++;
+        }
+      }
+    }
+    // Every sink beyond ring r is at least r buckets away
+    double reach = (double)r * ecoBucketSize;
+    if (nearest >= 0 && nearestDistance <= reach * reach) {
+      break;
+    }
+  }
+  return nearest;
+}
+
+int joinedCluster(EcoRun &run, const TierState &tier, int x, int y,
+                  int line) {
+  int cluster = nearestSinkCluster(tierIndex(run, tier.z), x, y);
+  if (cluster < 0) {
+    throw runtime_error("Sink change on line " + to_string(line) +
+                        ": tier " + to_string(tier.z) + " has no sinks");
+  }
+  return cluster;
+}
+
+// Indexes a tier sink that was just added to or moved within cluster, and
+// moves MIV sinks it landed next to out of its way, as a full run would
+void settleTierSink(EcoRun &run, TierState &tier, int cluster, int sinkIndex) {
+  TierIndex &index = tierIndex(run, tier.z);
+  const Sink sink = tier.clusters[cluster].sinks[sinkIndex];
+  indexSink(index, sink, cluster);
+  run.dirty[tier.z].insert(cluster);
+  for (const SinkSlot &slot : sinksNear(index, sink.x, sink.y, 1)) {
+    if (slot.z == sink.z)
+      continue;
+    ClusterState &holder = tier.clusters[slot.cluster];
+    int i = findClusterSink(holder, slot.x, slot.y, slot.z);
+    if (i < 0)
+      continue;
+    unindexSink(index, holder.sinks[i], slot.cluster);
+    placeMIVSink(index, holder.sinks[i], slot.cluster);
+    run.dirty[tier.z].insert(slot.cluster);
+  }
+}
+
+// Finds the tier sink at (x, y, z), throws if there is none
+pair<int, int> findTierSink(EcoRun &run, const TierState &tier, int x, int y,
+                            int line) {
+  for (const SinkSlot &slot : sinksNear(tierIndex(run, tier.z), x, y, 0)) {
+    if (slot.z != tier.z)
+      continue;
+    int i = findClusterSink(tier.clusters[slot.cluster], x, y, tier.z);
+    if (i >= 0) {
+      return {slot.cluster, i};
+    }
+  }
+  throw runtime_error("Sink change on line " + to_string(line) +
+                      ": no sink at (" + to_string(x) + "," + to_string(y) +
+                      "," + to_string(tier.z) + ")");
+}
+
+void addTierSink(EcoRun &run, const Sink &sink, int line) {
+  TierState &tier = ecoTier(run, sink.z, line);
+  int cluster = joinedCluster(run, tier, sink.x, sink.y, line);
+  tier.clusters[cluster].sinks.push_back(sink);
+  settleTierSink(run, tier, cluster,
+                 (int)tier.clusters[cluster].sinks.size() - 1);
+}
+
+Sink removeTierSink(EcoRun &run, int x, int y, int z, int line) {
+  TierState &tier = ecoTier(run, z, line);
+  pair<int, int> at = findTierSink(run, tier, x, y, line);
+  vector<Sink> &sinks = tier.clusters[at.first].sinks;
+  Sink sink = sinks[at.second];
+  unindexSink(tierIndex(run, z), sink, at.first);
+  sinks.erase(sinks.begin() + at.second);
+  run.dirty[z].insert(at.first);
+  return sink;
+}
+
+// Rejects a change that would put a sink outside the layout, which would
+// also send the nearest cluster search far beyond every sink
+void checkSinkChangeInLayout(const SynthesisContext &ctx,
+                             const SinkChange &change) {
+  int x = change.sink.x, y = change.sink.y;
+  if (change.kind == SinkChangeKind::Move) {
+    x = change.toX;
+    y = change.toY;
+  } else if (change.kind != SinkChangeKind::Add) {
+    return;
+  }
+  if (x < 0 || y < 0 || x > ctx.layout.width || y > ctx.layout.height) {
+    throw runtime_error("Sink change on line " + to_string(change.line) +
+                        ": (" + to_string(x) + "," + to_string(y) +
+                        ") is outside the layout");
+  }
+}
+
+void applySinkChange(EcoRun &run, const SinkChange &change) {
+  const Sink &sink = change.sink;
+  if (change.kind == SinkChangeKind::Add) {
+    Sink added(sink.x, sink.y, sink.z, sink.inputCapacitance);
+    addTierSink(run, added, change.line);
+    return;
+  }
+  if (change.kind == SinkChangeKind::Remove) {
+    removeTierSink(run, sink.x, sink.y, sink.z, change.line);
+    return;
+  }
+  // A sink moved within its tier keeps its DBSCAN label and its place in
+  // the cluster, so a sink moved back onto itself gives the subtree it had
+  TierState &tier = ecoTier(run, sink.z, change.line);
+  if (change.toZ == sink.z) {
+    pair<int, int> at = findTierSink(run, tier, sink.x, sink.y, change.line);
+    Sink &moved = tier.clusters[at.first].sinks[at.second];
+    unindexSink(tierIndex(run, sink.z), moved, at.first);
+    moved.x = change.toX;
+    moved.y = change.toY;
+    settleTierSink(run, tier, at.first, at.second);
+    return;
+  }
+  Sink moved = removeTierSink(run, sink.x, sink.y, sink.z, change.line);
+  moved.x = change.toX;
+  moved.y = change.toY;
+  moved.z = change.toZ;
+  addTierSink(run, moved, change.line);
+}
+
+// Whether the tier above sees a resynthesized cluster's MIV sink as it was:
+// same position and same delay
+bool sameMIVSink(const Sink &a, const Sink &b) {
+  return a.x == b.x && a.y == b.y && a.delay == b.delay;
+}
+
+// Hands a resynthesized (or emptied) cluster's MIV sink to the tier above,
+// replacing the one it had there, previousMIVSink. A root that came out as
+// it was leaves the tier above alone
+void passMIVSinkUp(EcoRun &run, int z, const ClusterState &cluster,
+                   const Sink &previousMIVSink) {
+  auto above = run.design.tiers.find(z + 1);
+  if (above == run.design.tiers.end()) {
+    return;
+  }
+  TierState &tier = above->second;
+  TierIndex &index = tierIndex(run, tier.z);
+  auto held = index.mivClusterOf.find(cluster.clusterId);
+  if (held != index.mivClusterOf.end()) {
+    if (!cluster.sinks.empty() &&
+        sameMIVSink(cluster.mivSink, previousMIVSink)) {
+      return;
+    }
+    int holder = held->second;
+    vector<Sink> &sinks = tier.clusters[holder].sinks;
+    for (size_t i = 0; i < sinks.size(); i++) {
+      if (sinks[i].sink_type != SinkType::MIV ||
+          sinks[i].cluster_id != cluster.clusterId)
+        continue;
+      unindexSink(index, sinks[i], holder);
+      if (cluster.sinks.empty()) {
+        sinks.erase(sinks.begin() + i);
+        index.mivClusterOf.erase(held);
+      } else {
+        sinks[i] = cluster.mivSink;
+        placeMIVSink(index, sinks[i], holder);
+      }
+      break;
+    }
+    run.dirty[tier.z].insert(holder);
+  } else if (!cluster.sinks.empty()) {
+    const Sink &miv = cluster.mivSink;
+    int holder = nearestSinkCluster(index, miv.x, miv.y);
+    if (holder < 0) {
+      throw runtime_error("MIV sink of cluster " +
+                          to_string(cluster.clusterId) + " of tier " +
+                          to_string(z) + " has no cluster to join: tier " +
+                          to_string(tier.z) + " has no sinks");
+    }
+    tier.clusters[holder].sinks.push_back(miv);
+    placeMIVSink(index, tier.clusters[holder].sinks.back(), holder);
+    index.mivClusterOf[cluster.clusterId] = holder;
+    run.dirty[tier.z].insert(holder);
+  }
+}
+
+// Rewrites a tier's export file and DBSCAN results from its clusters
+void writeTierFiles(SynthesisContext &ctx, const TierState &tier) {
+  ScopedTimer timer(ctx.metrics, Timer::Export);
+  string filename = tierExportFilename(ctx, tier.z);
+  TierExporter exporter(filename);
+  if (!exporter.is_open()) {
+    throw runtime_error("Error opening file for writing: " + filename);
+  }
+  vector<Point> points;
+  for (const ClusterState &cluster : tier.clusters) {
+    exporter.addBlock(cluster.exported);
+    for (const Sink &sink : cluster.sinks) {
+      points.push_back({(double)sink.x, (double)sink.y, cluster.clusterId});
+    }
+  }
+  string dbscanFilename = tierDBSCANFilename(ctx, tier.z);
+  remove(dbscanFilename.c_str());
+  outputDBSCANResults(points, tier.z, dbscanFilename);
+}
+
+// Applies the changes to the design and resynthesizes what they touch, tier
+// by tier from the bottom so MIV sinks are final before the tier above
+// runs. Returns the number of cluster subtrees resynthesized
+int applySinkChanges(SynthesisContext &ctx, DesignState &design,
+                     const vector<SinkChange> &changes) {
+  EcoRun run{design, {}, {}};
+  for (const SinkChange &change : changes) {
+    checkSinkChangeInLayout(ctx, change);
+    applySinkChange(run, change);
+  }
+
+  int resynthesized = 0;
+  for (auto &entry : design.tiers) {
+    int z = entry.first;
+    TierState &tier = entry.second;
+    auto dirty = run.dirty.find(z);
+    if (dirty == run.dirty.end()) {
+      continue;
+    }
+    TraceSpan tierSpan(ctx.tracer, "tier");
+    tierSpan.arg("z", z);
+    vector<int> changed, clusterIds;
+    vector<vector<Sink>> clusterSinks;
+    for (int c : dirty->second) {
+      ClusterState &cluster = tier.clusters[c];
+      if (cluster.sinks.empty()) {
+        LOG_DEBUG("ECO: cluster " << cluster.clusterId << " of tier " << z
+                  << " has no sinks left");
+        cluster.wirelength = 0;
+        cluster.exported.clear();
+        passMIVSinkUp(run, z, cluster, cluster.mivSink);
+        continue;
+      }
+      changed.push_back(c);
+      clusterIds.push_back(cluster.clusterId);
+      clusterSinks.push_back(cluster.sinks);
+    }
+
+    ctx.clusterMidpoints = tier.midpoints;
+    vector<ClusterSynthesis> results =
+        synthesizeClusterSinks(ctx, clusterIds, clusterSinks, z, design.bound);
+    for (size_t k = 0; k < results.size(); k++) {
+      const ClusterSynthesis &result = results[k];
+      ClusterState &cluster = tier.clusters[changed[k]];
+      cout << result.log;
+      LOG_DEBUG("ECO: resynthesized cluster " << cluster.clusterId
+                << " of tier " << z << ", wirelength " << cluster.wirelength
+                << " -> " << result.wirelength);
+      TraceSpan exportSpan(ctx.tracer, "export");
+      exportSpan.arg("cluster", cluster.clusterId);
+      cluster.exported.clear();
+      exportSubtree(result.root, cluster.exported);
+      exportSpan.stop();
+      cluster.wirelength = result.wirelength;
+      Sink previousMIVSink = cluster.mivSink;
+      cluster.mivSink = result.mivSink;
+      passMIVSinkUp(run, z, cluster, previousMIVSink);
+    }
+    resynthesized += (int)results.size();
+    releaseNodes(ctx);
+
+    // The tier's sinks and the MIV sinks from below are final by now
+    ScopedTimer mstTimer(ctx.metrics, Timer::IdealWirelength);
+    vector<Sink> tierSinks;
+    for (const ClusterState &cluster : tier.clusters) {
+      tierSinks.insert(tierSinks.end(), cluster.sinks.begin(),
+                       cluster.sinks.end());
+    }
+    TraceSpan mstSpan(ctx.tracer, "MST");
+    mstSpan.arg("sinks", (long long)tierSinks.size());
+    tier.idealWirelength = calculateWirelength(tierSinks);
+    mstSpan.stop();
+    mstTimer.stop();
+    writeTierFiles(ctx, tier);
+  }
+  return resynthesized;
+}
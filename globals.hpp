@@ -5,16 +5,8 @@
 
 using namespace std;
 
-// Global Variables
-Layout layout;
-WireUnits wireUnits;
-BufferUnits bufferUnits;
-TSVUnits tsvUnits;
-ClockSource clockSource;
-vector<Sink> sinks;
-vector<string> dieColors = {"Gray", "Red",    "Green",
-                            "Blue", "Purple", "Lime"}; // Define colors for dies
-int numSinks;
-int nodeID = 0;         // Global variable to keep track of the next node ID
-int zCutCount = 0;      // Keeps track of the number of Z-cuts performed
-int ZeroSkewMerges = 0; // Keeps track of the number of ZSMs performed
+// Global Constants. Everything a synthesis run changes lives in its
+// SynthesisContext (context.hpp)
+// Define colors for dies
+const vector<string> dieColors = {"Gray", "Red",    "Green",
+                                  "Blue", "Purple", "Lime"};
@@ -0,0 +1,60 @@
+#pragma once
+#include <iostream>
+using namespace std;
+
+// Log levels, from summary output down to per step detail. Statements above
+// MMM_LOG_LEVEL sit behind a constant false condition, so they are type
+// checked but generate no code and their arguments are never evaluated
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_INFO 1  // Parameters and summary metrics
+#define LOG_LEVEL_DEBUG 2 // Per tier and per cluster progress, trees
+#define LOG_LEVEL_TRACE 3 // Every cut, merge and DME step
+
+// Release builds (NDEBUG) keep only the summary, other builds keep the full
+// log. Either can be overridden with -DMMM_LOG_LEVEL=<level>
+#ifndef MMM_LOG_LEVEL
+#ifdef NDEBUG
+#define MMM_LOG_LEVEL LOG_LEVEL_INFO
+#else
+#define MMM_LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+// Whether statements of a level are compiled in. Use it to guard logging
+// loops and print helpers
+constexpr bool logEnabled(int level) { return level <= MMM_LOG_LEVEL; }
+
+// Where log statements on this thread go, cout unless set. Cluster jobs on
+// worker threads collect their lines here and main.cpp writes them out in
+// cluster order
+thread_local ostream *threadLog = nullptr;
+
+ostream &logStream() { return threadLog ? *threadLog : std::cout; }
+
+// Sends this thread's log to buffer for as long as the scope lives
+class ThreadLogScope {
+public:
+  explicit ThreadLogScope(ostream &buffer) : previous(threadLog) {
+    threadLog = &buffer;
+  }
+  ~ThreadLogScope() { threadLog = previous; }
+  ThreadLogScope(const ThreadLogScope &) = delete;
+  ThreadLogScope &operator=(const ThreadLogScope &) = delete;
+
+private:
+  ostream *previous;
+};
+
+// Writes message and a newline to the thread's log stream, by default cout,
+// which main.cpp points at the log file. Lines are not flushed, the stream
+// is flushed once when it closes
+#define MMM_LOG(level, message)                                                \
+  do {                                                                         \
+    if (logEnabled(level)) {                                                   \
+      logStream() << message << '\n';                                          \
+    }                                                                          \
+  } while (0)
+
+#define LOG_INFO(message) MMM_LOG(LOG_LEVEL_INFO, message)
+#define LOG_DEBUG(message) MMM_LOG(LOG_LEVEL_DEBUG, message)
+#define LOG_TRACE(message) MMM_LOG(LOG_LEVEL_TRACE, message)
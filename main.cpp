@@ -1,10 +1,18 @@
 #include "clustering.hpp"
+#include "context.hpp"
 #include "dme.hpp"
+#include "eco.hpp"
 #include "globals.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "sinkdb.hpp"
 #include "structures.hpp"
+#include "synthesis.hpp"
+#include "trace.hpp"
 #include "tree.hpp"
 #include "utilities.hpp"
 #include <chrono>
+#include <cstdlib>
 #include <iomanip>
 
 /* TODO
@@ -19,9 +27,55 @@ may cause it to throw an error or infinite loop!
 
 using namespace std;
 
-int main() {
-  cleanupPreviousFiles();
+int main(int argc, char *argv[]) {
+  // The design to read, a text benchmark or a sink database, and with
+  // --eco a sink delta file to apply to the design state a previous run
+  // saved instead of synthesizing from scratch. A full run saves the state
+  // only with --save-state, an ECO run always updates it. --trace writes a
+  // Chrome trace event timeline of the run to the given file. --threads
+  // caps the threads synthesis uses, one per hardware thread by default
+  string input = "benchmark10.txt";
+  string ecoDelta;
+  string traceFilename;
+  bool inputGiven = false;
+  bool saveState = false;
+  unsigned threads = 0; // 0 until --threads gives a count
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--eco" && i + 1 < argc && ecoDelta.empty()) {
+      ecoDelta = argv[++i];
+      saveState = true;
+    } else if (arg == "--save-state") {
+      saveState = true;
+    } else if (arg == "--trace" && i + 1 < argc && traceFilename.empty()) {
+      traceFilename = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc && threads == 0 &&
+               atoi(argv[i + 1]) > 0) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if (arg.compare(0, 2, "--") != 0 && !inputGiven) {
+      input = arg;
+      inputGiven = true;
+    } else {
+      cerr << "Usage: " << argv[0]
+           << " [benchmark or sink database] [--save-state]"
+              " [--eco <sink delta file>] [--trace <trace file>]"
+              " [--threads <count>]"
+           << endl;
+      return 1;
+    }
+  }
+  SynthesisContext ctx;
+  ctx.threads = threads > 0 ? threads : defaultThreadCount();
+  if (!traceFilename.empty()) {
+    ctx.tracer.enable();
+  }
+  if (ecoDelta.empty()) {
+    cleanupPreviousFiles(ctx);
+    // A state left by an earlier run no longer matches the files written
+    remove(designStateFilename(ctx).c_str());
+  }
   auto start = std::chrono::high_resolution_clock::now();
+  ScopedTimer totalTimer(ctx.metrics, Timer::Total);
   // Create log file with timestamp
   auto now = std::chrono::system_clock::now();
   auto time_t_now = std::chrono::system_clock::to_time_t(now);
@@ -38,119 +92,71 @@ int main() {
   std::cout.rdbuf(logFile.rdbuf());
   int bound = 150; // Inserts Bound+1 MIVs per tier, Bound MIVs + 1 MIV for the
                    // unclustered sinks, total MIVs inserted = (Bound * Tier)
-  int idealSum = 0;
-  int subtreeTotalSum = 0;
-  parseInput("benchmark10.txt");
-  displayParsedData();
-  // Separate sinks by their z-coordinate
-  map<int, vector<Sink>> sinksByZ;
-  std::map<int, std::vector<Sink>> tierMIVSinks;
-  for (const auto &sink : sinks) {
-    sinksByZ[sink.z].push_back(sink);
+  try {
+    readDesign(ctx, input);
+  } catch (const std::runtime_error &error) {
+    std::cout.rdbuf(coutBuf);
+    cerr << error.what() << endl;
+    return 1;
   }
-
-  for (const auto &pair : sinksByZ) {
-    int z = pair.first;
-    // const auto &sinksGroup = pair.second;
-    vector<Sink> sinksGroup = pair.second;
-    int tierZsmSum = 0;
-
-    // Add MIV sinks from lower tier (z-1) if they exist
-    if (z > 1 && tierMIVSinks.find(z - 1) != tierMIVSinks.end()) {
-      const auto &mivSinks = tierMIVSinks[z - 1];
-      sinksGroup.insert(sinksGroup.end(), mivSinks.begin(), mivSinks.end());
+  displayParsedData(ctx);
+  DesignState design;
+  if (ecoDelta.empty()) {
+    design = synthesizeDesign(ctx, bound);
+  } else {
+    // Only the clusters the changes touch are synthesized again. Changes
+    // are checked before anything is written
+    try {
+      design = loadDesignState(ctx);
+      int resynthesized =
+          applySinkChanges(ctx, design, readSinkChanges(ecoDelta));
+      LOG_INFO("ECO resynthesized " << resynthesized << " cluster subtrees");
+    } catch (const std::runtime_error &error) {
+      std::cout.rdbuf(coutBuf);
+      cerr << "ECO failed: " << error.what() << endl;
+      return 1;
     }
-
-    // For each z-coordinate, generate the tree and then perform zero skew tree
-    Node *root = AbsTreeGen3D(sinksGroup, bound - 1);
-    int wireLength = calculateWirelength(sinksGroup);
-    root->z = z; // Assign the z coordinate of the sink group to the root node
-    cout << "\nProcessing z-coordinate: " << z << endl;
-    // Create the tier-specific filename
-    string tierFilename =
-        "zeroskew_points_and_lines_z_" + to_string(z) + ".txt";
-    assignPhysicalLocations(root);
-    // assignPhysicalCharacteristics(root); WIP
-    // Baseline case, eps = layout.width, minPts=1 or numSinks
-    // double eps = layout.width * .085; // Epsilon distance
-    double eps = layout.width; // Epsilon distance
-    int minPts = 1;            // Minimum points to form a cluster
-    runDBSCANAndAssignClusters(root, eps, minPts, bound - 1);
-    clusterMidpoints = calculateClusterMidpoints(root);
-    //  Create subtrees for each cluster
-    std::vector<Node *> clusterRoots = createClusterSubtrees(root);
-    printNodesByClusterId(root);
-    calculateClusterMidpoints(root);
-    // Print each subtree using printTree function
-    for (Node *subtreeRoot : clusterRoots) {
-      std::cout << "Printing subtree with Cluster ID: "
-                << subtreeRoot->cluster_id << std::endl;
-      Point currMidpoint = getMidpointByClusterId(subtreeRoot->cluster_id);
-      std::cout << "Cluster " << subtreeRoot->cluster_id << " midpoint ("
-                << currMidpoint.x << "," << currMidpoint.y << ")" << endl;
-      std::vector<Sink> subtreeSinks = treeToSinkVector(subtreeRoot);
-      Node *AbstractSubtree = AbsTreeGen3D(subtreeSinks, bound - 1);
-      std::cout << "***********************************" << std::endl;
-      assignPhysicalLocations(AbstractSubtree);
-      assignClusterIdToTree(AbstractSubtree, subtreeRoot->cluster_id);
-      depthFirstCapacitance(AbstractSubtree);
-      depthFirstDelay(AbstractSubtree, tsvUnits.resistance);
-      Node *zeroSkewSubtree = zeroSkewTree(AbstractSubtree);
-      zeroSkewSubtree->node_type = "MIV";
-      depthFirstCapacitance(zeroSkewSubtree);
-      depthFirstDelay(zeroSkewSubtree, tsvUnits.resistance);
-
-      // Store the subtree information in map
-      Sink rootSink;
-      rootSink.x = zeroSkewSubtree->x;
-      rootSink.y = zeroSkewSubtree->y;
-      rootSink.z = z;
-      rootSink.delay = zeroSkewSubtree->elmoreDelay;
-      rootSink.cluster_id = zeroSkewSubtree->cluster_id;
-      rootSink.sink_type = "MIV";
-      tierMIVSinks[z].push_back(rootSink);
-      printTree(zeroSkewSubtree);
-
-      int subtreeZsmWireLength =
-          calculateZeroSkewTreeWirelength(AbstractSubtree);
-      cout << "~~~Zero Skew Tree Wirelength for cluster "
-           << subtreeRoot->cluster_id << ": " << subtreeZsmWireLength << endl;
-      std::cout << "---------------------------------" << std::endl;
-      tierZsmSum += subtreeZsmWireLength;
-      cout << "subtreeZsmSum for z " << z << "=" << tierZsmSum << endl;
-
-      // Export each subtree to the tier-specific file in append mode
-      exportPointsAndLines(zeroSkewSubtree, tierFilename);
-      cout << "Exported subtree for cluster " << subtreeRoot->cluster_id
-           << " to tier " << z << " file" << endl;
-      deleteTree(zeroSkewSubtree); // Clean up after exporting
+  }
+  if (saveState) {
+    try {
+      saveDesignState(ctx, design);
+    } catch (const std::runtime_error &error) {
+      std::cout.rdbuf(coutBuf);
+      cerr << "Saving the design state failed: " << error.what() << endl;
+      return 1;
     }
-
-    cout << "Completed exporting all subtrees for tier " << z << " to "
-         << tierFilename << endl;
-
-    idealSum += wireLength;
-    subtreeTotalSum += tierZsmSum;
-    deleteTree(root); // Clean up after exporting (Might not be right)
   }
   // To print/access the information:
-  for (const auto &pair : tierMIVSinks) {
-    cout << "Tier " << pair.first << " subtree roots:" << endl;
-    for (const auto &sink : pair.second) {
-      cout << "Sink type: " << sink.sink_type << "Cluster " << sink.cluster_id
-           << " at (" << sink.x << "," << sink.y << ") with delay "
-           << sink.delay << endl;
+  printTierMIVSinks(design);
+  int idealSum = idealWirelength(design);
+  int subtreeTotalSum = zeroSkewWirelength(design);
+  auto end = std::chrono::high_resolution_clock::now();
+  totalTimer.stop();
+  // Stage timers and event counters, for tools to read
+  string metricsFilename = ctx.outputPrefix + "metrics.json";
+  std::ofstream metricsFile(metricsFilename);
+  if (metricsFile.is_open()) {
+    writeMetrics(ctx.metrics, metricsFile);
+  } else {
+    std::cerr << "Error opening file for writing: " << metricsFilename
+              << std::endl;
+  }
+  if (!traceFilename.empty()) {
+    std::ofstream traceFile(traceFilename);
+    if (traceFile.is_open()) {
+      ctx.tracer.write(traceFile);
+    } else {
+      std::cerr << "Error opening file for writing: " << traceFilename
+                << std::endl;
     }
   }
-  auto end = std::chrono::high_resolution_clock::now();
   // Calculate runtime
   auto duration =
       std::chrono::duration_cast<std::chrono::microseconds>(end - start);
   // Cout to logfile
-  cout << "Ideal Wirelength Sum = " << idealSum << endl;
-  cout << "Cluster ZST total = " << subtreeTotalSum << endl;
-  std::cout << "Execution time: " << duration.count() << " microseconds"
-            << std::endl;
+  LOG_INFO("Ideal Wirelength Sum = " << idealSum);
+  LOG_INFO("Cluster ZST total = " << subtreeTotalSum);
+  LOG_INFO("Execution time: " << duration.count() << " microseconds");
   // Cout to console
   std::cout.rdbuf(coutBuf);
   cout << "Ideal Wirelength Sum = " << idealSum << endl;
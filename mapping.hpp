@@ -0,0 +1,56 @@
+#pragma once
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// View of a whole file mapped into memory. Read only, or copy on write:
+// writes then go to private pages and never reach the file
+class MappedFile {
+public:
+  explicit MappedFile(const string &filename, bool copyOnWrite = false)
+      : data(nullptr), size(0), opened(false) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0) {
+      size = (size_t)info.st_size;
+      if (size == 0) {
+        opened = true; // Nothing to map
+      } else {
+        int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *mapped = mmap(nullptr, size, protection, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+          data = (char *)mapped;
+          opened = true;
+          // Read front to back once
+          madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+      }
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data) {
+      munmap(data, size);
+    }
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool is_open() const { return opened; }
+  size_t length() const { return size; }
+  const char *begin() const { return data; }
+  const char *end() const { return data + size; }
+  // Only for copy on write mappings
+  char *mutableData() { return data; }
+
+private:
+  char *data;
+  size_t size;
+  bool opened;
+};
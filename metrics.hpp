@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+using namespace std;
+
+// Run metrics: wall time spent in each stage of the pipeline and counts of
+// the events inside it. Every SynthesisContext owns a Metrics, which any
+// thread of the run may update. Timers and counters are relaxed atomics,
+// cheap enough to leave on in every build
+
+// Stages that are timed. A stage may be entered many times, its timer sums
+// them and counts the calls
+enum class Timer : int {
+  Parse,             // Reading the design
+  IdealWirelength,   // Minimum spanning tree of each tier
+  TierTree,          // Abstract tree over each tier's sinks
+  DBSCAN,            // Clustering each tier
+  Midpoints,         // Cluster midpoints of each tier
+  ClusterSubtrees,   // Splitting each tier tree into cluster subtrees
+  ClusterSynthesis,  // Synthesizing the clusters of a tier, wall time
+  SynthesizeCluster, // One cluster, summed over the threads that ran them
+  Export,            // Writing the tier export files
+  Total,             // Everything main does
+  Count
+};
+
+const char *const timerNames[] = {
+    "parse",           "idealWirelength",  "tierTree",
+    "dbscan",          "midpoints",        "clusterSubtrees",
+    "clusterSynthesis", "synthesizeCluster", "export",
+    "total"};
+
+enum class Counter : int {
+  ZCuts,              // Z-cuts while building abstract trees
+  ZeroSkewMerges,     // Merges of two subtrees
+  MergesInRange,      // Merges whose tapping point lies on the wire
+  MergesExtendLeft,   // Tapping point beyond subtree 1, x < 0
+  MergesExtendRight,  // Tapping point beyond subtree 2, x > 1
+  BufferInsertions,   // Extensions replaced by a buffer
+  Count
+};
+
+const char *const counterNames[] = {
+    "zCuts",           "zeroSkewMerges",    "mergesInRange",
+    "mergesExtendLeft", "mergesExtendRight", "bufferInsertions"};
+
+static_assert(sizeof timerNames / sizeof *timerNames == (int)Timer::Count,
+              "a name for every timer");
+static_assert(sizeof counterNames / sizeof *counterNames ==
+                  (int)Counter::Count,
+              "a name for every counter");
+
+struct Metrics {
+  atomic<long long> counters[(int)Counter::Count]{};
+  atomic<long long> timerNanoseconds[(int)Timer::Count]{};
+  atomic<long long> timerCalls[(int)Timer::Count]{};
+
+  void add(Counter counter, long long amount = 1) {
+    counters[(int)counter].fetch_add(amount, memory_order_relaxed);
+  }
+  long long value(Counter counter) const {
+    return counters[(int)counter].load(memory_order_relaxed);
+  }
+  void addTime(Timer timer, chrono::steady_clock::duration elapsed) {
+    timerNanoseconds[(int)timer].fetch_add(
+        chrono::duration_cast<chrono::nanoseconds>(elapsed).count(),
+        memory_order_relaxed);
+    timerCalls[(int)timer].fetch_add(1, memory_order_relaxed);
+  }
+  double seconds(Timer timer) const {
+    return timerNanoseconds[(int)timer].load(memory_order_relaxed) * 1e-9;
+  }
+  long long calls(Timer timer) const {
+    return timerCalls[(int)timer].load(memory_order_relaxed);
+  }
+};
+
+// Adds the time from construction to stop(), or to the end of the scope, to
+// a timer
+class ScopedTimer {
+public:
+  ScopedTimer(Metrics &metrics, Timer timer)
+      : metrics(metrics), timer(timer), start(chrono::steady_clock::now()) {}
+  ~ScopedTimer() { stop(); }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  void stop() {
+    if (running) {
+      metrics.addTime(timer, chrono::steady_clock::now() - start);
+      running = false;
+    }
+  }
+
+private:
+  Metrics &metrics;
+  Timer timer;
+  chrono::steady_clock::time_point start;
+  bool running = true;
+};
+
+// Seconds from start to now, and start moved to now, so runs back to back
+// can be timed with one clock
+double lapSeconds(chrono::steady_clock::time_point &start) {
+  chrono::steady_clock::time_point now = chrono::steady_clock::now();
+  double seconds = chrono::duration<double>(now - start).count();
+  start = now;
+  return seconds;
+}
+
+// Writes the metrics as one JSON object, timers in seconds
+void writeMetrics(const Metrics &metrics, ostream &out) {
+  out << "{\n  \"timers\": {";
+  for (int t = 0; t < (int)Timer::Count; t++) {
+    out << (t ? ",\n" : "\n") << "    \"" << timerNames[t]
+        << "\": {\"seconds\": " << fixed << setprecision(9)
+        << metrics.seconds((Timer)t)
+        << ", \"calls\": " << metrics.calls((Timer)t) << "}";
+  }
+  out << "\n  },\n  \"counters\": {";
+  for (int c = 0; c < (int)Counter::Count; c++) {
+    out << (c ? ",\n" : "\n") << "    \"" << counterNames[c]
+        << "\": " << metrics.value((Counter)c);
+  }
+  out << "\n  }\n}\n";
+}
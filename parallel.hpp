@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Worker count used when none is asked for, one per hardware thread
+unsigned defaultThreadCount() {
+  unsigned count = thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
+
+// Threads fork-join work started on this thread may spread over, 0 for no
+// limit. Set while running a job of a parallel loop, so that nested
+// parallel algorithms share the threads the loop already uses
+thread_local unsigned threadBudget = 0;
+
+// Threads a parallel algorithm asking for requested threads may use here
+unsigned availableThreads(unsigned requested) {
+  return threadBudget ? std::min(threadBudget, requested) : requested;
+}
+
+// Sets this thread's threadBudget for as long as the scope lives
+class ThreadBudgetScope {
+public:
+  explicit ThreadBudgetScope(unsigned budget) : previous(threadBudget) {
+    threadBudget = budget;
+  }
+  ~ThreadBudgetScope() { threadBudget = previous; }
+  ThreadBudgetScope(const ThreadBudgetScope &) = delete;
+  ThreadBudgetScope &operator=(const ThreadBudgetScope &) = delete;
+
+private:
+  unsigned previous;
+};
+
+// Runs first(share) on a new thread and second(share) on this one, splitting
+// budget threads between them, or both here one after the other when the
+// budget is a single thread. Each side runs with its share as threadBudget.
+// An exception from either side is rethrown once both have finished
+template <typename First, typename Second>
+void forkJoin(unsigned budget, First first, Second second) {
+  if (budget <= 1) {
+    first(1u);
+    second(1u);
+    return;
+  }
+  unsigned firstShare = budget / 2;
+  unsigned secondShare = budget - firstShare;
+  exception_ptr firstError, secondError;
+  thread worker([&]() {
+    ThreadBudgetScope scope(firstShare);
+    try {
+      first(firstShare);
+    } catch (...) {
+      firstError = current_exception();
+    }
+  });
+  {
+    ThreadBudgetScope scope(secondShare);
+    try {
+      second(secondShare);
+    } catch (...) {
+      secondError = current_exception();
+    }
+  }
+  worker.join();
+  if (firstError) {
+    rethrow_exception(firstError);
+  }
+  if (secondError) {
+    rethrow_exception(secondError);
+  }
+}
+
+// Runs job(i) for every i in [0, sizes.size()) on up to threads threads, the
+// calling thread included. Jobs are handed out largest size first so a big
+// one is never left to run alone at the end. Each thread runs its jobs with
+// an equal share of the threads as threadBudget, so a single job still gets
+// all of them. The first exception a job throws is rethrown here once every
+// thread has finished
+template <typename Job>
+void runLargestFirst(const vector<size_t> &sizes, unsigned threads, Job job) {
+  vector<size_t> order(sizes.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  // Threads beyond one per job are left to the jobs themselves
+  unsigned total = std::max(availableThreads(threads), 1u);
+  threads = (unsigned)std::min<size_t>(total, order.size());
+  unsigned share = threads > 0 ? total / threads : 1;
+  atomic<size_t> next(0);
+  exception_ptr error;
+  mutex errorLock;
+  auto worker = [&]() {
+    ThreadBudgetScope scope(std::max(share, 1u));
+    for (size_t k = next++; k < order.size(); k = next++) {
+      try {
+        job(order[k]);
+      } catch (...) {
+        lock_guard<mutex> lock(errorLock);
+        if (!error) {
+          error = current_exception();
+        }
+      }
+    }
+  };
+
+  vector<thread> pool;
+  for (unsigned t = 1; t < threads; t++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (thread &t : pool) {
+    t.join();
+  }
+  if (error) {
+    rethrow_exception(error);
+  }
+}
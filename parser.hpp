@@ -0,0 +1,149 @@
+#pragma once
+#include "context.hpp"
+#include "mapping.hpp"
+#include "structures.hpp"
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+// Walks the records of a benchmark file: lines of numbers, each optionally
+// followed by a // comment. Blank and comment-only lines are skipped. Only
+// ever points into the mapped file, nothing is copied or allocated
+struct InputCursor {
+  const char *next;   // Start of the line after the current one
+  const char *end;    // End of the file
+  const char *field;  // Where the next field of the current line starts
+  const char *lineEnd;
+  int line;           // Number of the current line, from 1
+  const string &filename;
+};
+
+bool isFieldSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+void skipFieldSpace(InputCursor &in) {
+  while (in.field != in.lineEnd && isFieldSpace(*in.field)) {
+    in.field++;
+  }
+}
+
+bool atLineComment(const InputCursor &in) {
+  return in.lineEnd - in.field >= 2 && in.field[0] == '/' &&
+         in.field[1] == '/';
+}
+
+// Reports a malformed input line, like a file that cannot be read, as a
+// runtime_error naming the file and line
+[[noreturn]] void inputError(const InputCursor &in, const string &message) {
+  throw runtime_error(in.filename + ":" + to_string(in.line) + ": " +
+                      message);
+}
+
+// Moves to the next line that holds a record, false at the end of the file
+bool nextRecord(InputCursor &in) {
+  while (in.next != in.end) {
+    in.field = in.next;
+    const void *newline = memchr(in.next, '\n', in.end - in.next);
+    in.lineEnd = newline ? (const char *)newline : in.end;
+    in.next = in.lineEnd == in.end ? in.end : in.lineEnd + 1;
+    in.line++;
+    skipFieldSpace(in);
+    if (in.field != in.lineEnd && !atLineComment(in)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads the next number of the current line, which must end at a space,
+// a comment or the end of the line
+template <typename T> T readField(InputCursor &in, const char *name) {
+  skipFieldSpace(in);
+  T value{};
+  from_chars_result result = from_chars(in.field, in.lineEnd, value);
+  if (result.ec != errc() ||
+      (result.ptr != in.lineEnd && !isFieldSpace(*result.ptr) &&
+       *result.ptr != '/')) {
+    inputError(in, string("expected ") + name);
+  }
+  in.field = result.ptr;
+  return value;
+}
+
+// Checks nothing but a comment follows the fields of the current line
+void endRecord(InputCursor &in) {
+  skipFieldSpace(in);
+  if (in.field != in.lineEnd && !atLineComment(in)) {
+    inputError(in, "unexpected text after the last field");
+  }
+}
+
+void expectRecord(InputCursor &in, const char *what) {
+  if (!nextRecord(in)) {
+    in.line++;
+    inputError(in, string("unexpected end of file, expected ") + what);
+  }
+}
+
+// Reads a benchmark file: five parameter lines, the sink count, then one
+// "x y z capacitance" line per sink. Throws runtime_error when the file
+// cannot be read or a line is malformed
+void parseInput(SynthesisContext &ctx, const string &filename) {
+  MappedFile file(filename);
+  if (!file.is_open()) {
+    throw runtime_error("Error opening file: " + filename);
+  }
+  InputCursor in{file.begin(), file.end(), nullptr, nullptr, 0, filename};
+
+  expectRecord(in, "the layout area");
+  ctx.layout.width = readField<double>(in, "the layout width");
+  ctx.layout.height = readField<double>(in, "the layout height");
+  ctx.layout.numDies = readField<int>(in, "the number of dies");
+  endRecord(in);
+  expectRecord(in, "the wire parameters");
+  ctx.wireUnits.resistance = readField<double>(in, "the wire resistance");
+  ctx.wireUnits.capacitance = readField<double>(in, "the wire capacitance");
+  endRecord(in);
+  expectRecord(in, "the buffer parameters");
+  ctx.bufferUnits.outputResistance =
+      readField<double>(in, "the buffer output resistance");
+  ctx.bufferUnits.inputCapacitance =
+      readField<double>(in, "the buffer input capacitance");
+  ctx.bufferUnits.intrinsicDelay =
+      readField<double>(in, "the buffer intrinsic delay");
+  endRecord(in);
+  expectRecord(in, "the TSV parameters");
+  ctx.tsvUnits.resistance = readField<double>(in, "the TSV resistance");
+  ctx.tsvUnits.capacitance = readField<double>(in, "the TSV capacitance");
+  endRecord(in);
+  expectRecord(in, "the clock source");
+  ctx.clockSource.x = readField<int>(in, "the clock source x");
+  ctx.clockSource.y = readField<int>(in, "the clock source y");
+  ctx.clockSource.z = readField<int>(in, "the clock source z");
+  ctx.clockSource.outputResistance =
+      readField<double>(in, "the clock output resistance");
+  endRecord(in);
+  expectRecord(in, "the number of sinks");
+  ctx.numSinks = readField<int>(in, "the number of sinks");
+  if (ctx.numSinks < 0) {
+    inputError(in, "negative number of sinks");
+  }
+  endRecord(in);
+
+  ctx.sinks.reserve(ctx.sinks.size() + ctx.numSinks);
+  for (int i = 0; i < ctx.numSinks; ++i) {
+    if (!nextRecord(in)) {
+      in.line++;
+      inputError(in, "expected " + to_string(ctx.numSinks) +
+                         " sinks, found " + to_string(i));
+    }
+    Sink sink;
+    sink.x = readField<int>(in, "the sink x");
+    sink.y = readField<int>(in, "the sink y");
+    sink.z = readField<int>(in, "the sink z");
+    sink.inputCapacitance = readField<double>(in, "the sink capacitance");
+    endRecord(in);
+    ctx.sinks.push_back(sink);
+  }
+}
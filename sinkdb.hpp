@@ -0,0 +1,240 @@
+#pragma once
+#include "context.hpp"
+#include "mapping.hpp"
+#include "parser.hpp"
+#include "structures.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// Binary sink database. A fixed header holds the design parameters, then
+// the sinks follow as Sink records laid out exactly as in memory, so the
+// mapped file serves as the sink array without being read. The header
+// records the writer's byte order and the offset and size of every Sink
+// field, and a file whose layout differs from the reader's in any of them
+// is rejected rather than misread. Only a sink's position and input
+// capacitance come from the design, the fields synthesis fills in are
+// stored as a freshly read sink has them. Utilities/convert_benchmark.cpp
+// writes one from a text benchmark
+
+const char sinkDatabaseMagic[8] = {'M', 'M', 'M', 'S', 'I', 'N', 'K', 'S'};
+const uint32_t sinkDatabaseVersion = 2;
+const uint32_t sinkDatabaseByteOrder = 0x01020304;
+const uint64_t sinkDatabaseAlignment = 64; // Of the sink array in the file
+
+// Header flags
+const uint32_t sinkDatabaseTierSorted = 1; // Sinks in ascending z order
+
+// Where one Sink field lies in a record
+struct SinkFieldLayout {
+  uint16_t offset;
+  uint16_t size;
+};
+
+// The Sink layout of this build, field by field in declaration order
+const SinkFieldLayout sinkFieldLayouts[] = {
+    {offsetof(Sink, inputCapacitance), sizeof(Sink::inputCapacitance)},
+    {offsetof(Sink, capacitance), sizeof(Sink::capacitance)},
+    {offsetof(Sink, delay), sizeof(Sink::delay)},
+    {offsetof(Sink, x), sizeof(Sink::x)},
+    {offsetof(Sink, y), sizeof(Sink::y)},
+    {offsetof(Sink, z), sizeof(Sink::z)},
+    {offsetof(Sink, cluster_id), sizeof(Sink::cluster_id)},
+    {offsetof(Sink, dieIndex), sizeof(Sink::dieIndex)},
+    {offsetof(Sink, sink_type), sizeof(Sink::sink_type)},
+};
+const int sinkFieldCount =
+    sizeof sinkFieldLayouts / sizeof sinkFieldLayouts[0];
+
+struct SinkDatabaseHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t sinkSize; // sizeof(Sink) of the writer
+  uint32_t flags;
+  SinkFieldLayout sinkFields[sinkFieldCount]; // Sink layout of the writer
+  uint64_t sinkCount;
+  uint64_t sinkOffset; // Start of the sink array in the file
+  double layoutWidth, layoutHeight;
+  double wireResistance, wireCapacitance;
+  double bufferOutputResistance, bufferInputCapacitance, bufferIntrinsicDelay;
+  double tsvResistance, tsvCapacitance;
+  double clockOutputResistance;
+  int32_t numDies;
+  int32_t clockX, clockY, clockZ;
+};
+static_assert(is_trivially_copyable<Sink>::value &&
+                  is_standard_layout<Sink>::value,
+              "Sink records are stored as raw bytes");
+static_assert(sinkDatabaseAlignment % alignof(Sink) == 0,
+              "the mapped sink array must be aligned for Sink");
+
+// The record stored for sink: its position and input capacitance, the
+// other fields as a freshly read sink has them and padding zeroed, so equal
+// designs give equal files
+Sink packedSink(const Sink &sink) {
+  Sink fresh(sink.x, sink.y, sink.z, sink.inputCapacitance);
+  Sink record;
+  memset((void *)&record, 0, sizeof record);
+  record.inputCapacitance = fresh.inputCapacitance;
+  record.capacitance = fresh.capacitance;
+  record.delay = fresh.delay;
+  record.x = fresh.x;
+  record.y = fresh.y;
+  record.z = fresh.z;
+  record.cluster_id = fresh.cluster_id;
+  record.dieIndex = fresh.dieIndex;
+  record.sink_type = fresh.sink_type;
+  return record;
+}
+
+// Writes the context's design to filename, with the sinks sorted by tier
+// when tierSorted (stable, so each tier keeps its input order)
+void writeSinkDatabase(SynthesisContext &ctx, const string &filename,
+                       bool tierSorted) {
+  SinkSpan sinks = designSinks(ctx);
+  vector<size_t> order(sinks.size());
+  iota(order.begin(), order.end(), 0);
+  if (tierSorted) {
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return sinks[a].z < sinks[b].z;
+    });
+  }
+
+  SinkDatabaseHeader header;
+  memset(&header, 0, sizeof header);
+  memcpy(header.magic, sinkDatabaseMagic, sizeof header.magic);
+  header.version = sinkDatabaseVersion;
+  header.byteOrder = sinkDatabaseByteOrder;
+  header.sinkSize = sizeof(Sink);
+  header.flags = tierSorted ? sinkDatabaseTierSorted : 0;
+  memcpy(header.sinkFields, sinkFieldLayouts, sizeof header.sinkFields);
+  header.sinkCount = sinks.size();
+  header.sinkOffset = (sizeof header + sinkDatabaseAlignment - 1) /
+                      sinkDatabaseAlignment * sinkDatabaseAlignment;
+  header.layoutWidth = ctx.layout.width;
+  header.layoutHeight = ctx.layout.height;
+  header.numDies = ctx.layout.numDies;
+  header.wireResistance = ctx.wireUnits.resistance;
+  header.wireCapacitance = ctx.wireUnits.capacitance;
+  header.bufferOutputResistance = ctx.bufferUnits.outputResistance;
+  header.bufferInputCapacitance = ctx.bufferUnits.inputCapacitance;
+  header.bufferIntrinsicDelay = ctx.bufferUnits.intrinsicDelay;
+  header.tsvResistance = ctx.tsvUnits.resistance;
+  header.tsvCapacitance = ctx.tsvUnits.capacitance;
+  header.clockX = ctx.clockSource.x;
+  header.clockY = ctx.clockSource.y;
+  header.clockZ = ctx.clockSource.z;
+  header.clockOutputResistance = ctx.clockSource.outputResistance;
+
+  ofstream out(filename, ios::binary);
+  if (!out.is_open()) {
+    throw runtime_error("Error opening file for writing: " + filename);
+  }
+  out.write((const char *)&header, sizeof header);
+  vector<char> padding(header.sinkOffset - sizeof header, 0);
+  out.write(padding.data(), padding.size());
+  // Written in chunks, the records never exist twice in memory in full
+  vector<Sink> chunk;
+  chunk.reserve(4096);
+  for (size_t i = 0; i < order.size(); i++) {
+    chunk.push_back(packedSink(sinks[order[i]]));
+    if (chunk.size() == chunk.capacity() || i + 1 == order.size()) {
+      out.write((const char *)chunk.data(), chunk.size() * sizeof(Sink));
+      chunk.clear();
+    }
+  }
+  if (!out) {
+    throw runtime_error("Error writing file: " + filename);
+  }
+}
+
+// Whether filename starts like a sink database
+bool isSinkDatabase(const string &filename) {
+  ifstream in(filename, ios::binary);
+  char magic[sizeof sinkDatabaseMagic];
+  return in.read(magic, sizeof magic) &&
+         memcmp(magic, sinkDatabaseMagic, sizeof magic) == 0;
+}
+
+[[noreturn]] void sinkDatabaseError(const string &filename,
+                                    const string &message) {
+  throw runtime_error(filename + ": " + message);
+}
+
+// Maps a sink database as the context's design. The sinks stay in the
+// mapping, copy on write so the design may be changed in memory. Throws
+// runtime_error like parseInput when the file cannot be used
+void loadSinkDatabase(SynthesisContext &ctx, const string &filename) {
+  auto file = make_unique<MappedFile>(filename, true);
+  if (!file->is_open()) {
+    throw runtime_error("Error opening file: " + filename);
+  }
+  SinkDatabaseHeader header;
+  if (file->length() < sizeof header) {
+    sinkDatabaseError(filename, "too short for a sink database");
+  }
+  memcpy(&header, file->begin(), sizeof header);
+  if (memcmp(header.magic, sinkDatabaseMagic, sizeof header.magic) != 0) {
+    sinkDatabaseError(filename, "not a sink database");
+  }
+  if (header.version != sinkDatabaseVersion) {
+    sinkDatabaseError(filename, "sink database version " +
+                                    to_string(header.version) +
+                                    " is not supported");
+  }
+  if (header.byteOrder != sinkDatabaseByteOrder ||
+      header.sinkSize != sizeof(Sink) ||
+      memcmp(header.sinkFields, sinkFieldLayouts,
+             sizeof header.sinkFields) != 0) {
+    sinkDatabaseError(filename,
+                      "written with a different byte order or Sink layout");
+  }
+  if (header.sinkOffset % sinkDatabaseAlignment != 0 ||
+      header.sinkCount > (uint64_t)INT_MAX ||
+      header.sinkOffset > file->length() ||
+      header.sinkCount > (file->length() - header.sinkOffset) / sizeof(Sink)) {
+    sinkDatabaseError(filename, "sink array out of bounds");
+  }
+
+  ctx.layout.width = header.layoutWidth;
+  ctx.layout.height = header.layoutHeight;
+  ctx.layout.numDies = header.numDies;
+  ctx.wireUnits.resistance = header.wireResistance;
+  ctx.wireUnits.capacitance = header.wireCapacitance;
+  ctx.bufferUnits.outputResistance = header.bufferOutputResistance;
+  ctx.bufferUnits.inputCapacitance = header.bufferInputCapacitance;
+  ctx.bufferUnits.intrinsicDelay = header.bufferIntrinsicDelay;
+  ctx.tsvUnits.resistance = header.tsvResistance;
+  ctx.tsvUnits.capacitance = header.tsvCapacitance;
+  ctx.clockSource.x = header.clockX;
+  ctx.clockSource.y = header.clockY;
+  ctx.clockSource.z = header.clockZ;
+  ctx.clockSource.outputResistance = header.clockOutputResistance;
+  ctx.numSinks = (int)header.sinkCount;
+  Sink *first = (Sink *)(file->mutableData() + header.sinkOffset);
+  ctx.databaseSinks = SinkSpan(first, first + header.sinkCount);
+  ctx.sinksTierSorted = (header.flags & sinkDatabaseTierSorted) != 0;
+  ctx.sinkDatabase = std::move(file);
+}
+
+// Reads a design from a text benchmark or a sink database, whichever the
+// file holds
+void readDesign(SynthesisContext &ctx, const string &filename) {
+  ScopedTimer timer(ctx.metrics, Timer::Parse);
+  if (isSinkDatabase(filename)) {
+    loadSinkDatabase(ctx, filename);
+  } else {
+    parseInput(ctx, filename);
+  }
+}
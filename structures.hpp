@@ -1,5 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <new>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -36,45 +40,159 @@ struct Point {
   int clusterId; // -1 for noise, 0 for unvisited, >0 for cluster IDs
 };
 
+enum class SinkType : uint8_t { Sink, MIV };
+
+// Name used in logs for a sink type
+const char *sinkTypeName(SinkType type) {
+  return type == SinkType::MIV ? "MIV" : "sink";
+}
+
+// Packed to 48 bytes: doubles first, then ints, then the one byte fields
 struct Sink {
-  int x, y, z;             // Unit: None, coordinates in an unspecified grid
   double inputCapacitance; // Unit: femtofarads (fF)
   double capacitance;      // Unit: femtofarads (fF)
-  string color;            // Unit: None, simply a descriptive string
   double delay;            // Unit: picoseconds (ps)
+  int x, y, z;             // Unit: None, coordinates in an unspecified grid
   int cluster_id;
-  string sink_type;
+  uint8_t dieIndex; // Index into dieColors, 0 (Gray) is uncolored
+  SinkType sink_type;
   // Constructor with default sink color set to gray/uncolored
   Sink(int x = 0, int y = 0, int z = 0, double inputCapacitance = 0,
-       double capacitance = 0, string color = "Gray", double delay = 0,
-       int cluster_id = -1, string sink_type = "sink")
-      : x(x), y(y), z(z), inputCapacitance(inputCapacitance),
-        capacitance(capacitance), color(color), delay(delay),
-        cluster_id(cluster_id), sink_type(sink_type) {}
+       double capacitance = 0, uint8_t dieIndex = 0, double delay = 0,
+       int cluster_id = -1, SinkType sink_type = SinkType::Sink)
+      : inputCapacitance(inputCapacitance), capacitance(capacitance),
+        delay(delay), x(x), y(y), z(z), cluster_id(cluster_id),
+        dieIndex(dieIndex), sink_type(sink_type) {}
+};
+static_assert(sizeof(Sink) <= 64, "a Sink should fit in one cache line");
+
+// [first, last) run of a sink array. Every node of an abstract tree looks at
+// its sinks through one of these into a single array owned by the tree,
+// instead of holding its own copy
+struct SinkSpan {
+  Sink *first;
+  Sink *last;
+  SinkSpan() : first(nullptr), last(nullptr) {}
+  SinkSpan(Sink *first, Sink *last) : first(first), last(last) {}
+  SinkSpan(vector<Sink> &sinks)
+      : first(sinks.data()), last(sinks.data() + sinks.size()) {}
+  Sink *begin() const { return first; }
+  Sink *end() const { return last; }
+  size_t size() const { return last - first; }
+  bool empty() const { return first == last; }
+  Sink &front() const { return *first; }
+  Sink &operator[](size_t i) const { return first[i]; }
 };
 
+enum class NodeType : uint8_t {
+  Undefined,
+  Leaf,
+  MergingPoint,
+  MIV,
+  ClockSource,
+  ClusterRoot
+};
+
+// Name used in logs for a node type
+const char *nodeTypeName(NodeType type) {
+  switch (type) {
+  case NodeType::Leaf:
+    return "Leaf";
+  case NodeType::MergingPoint:
+    return "Merging Point";
+  case NodeType::MIV:
+    return "MIV";
+  case NodeType::ClockSource:
+    return "ClockSource";
+  case NodeType::ClusterRoot:
+    return "ClusterRoot";
+  default:
+    return "undefined";
+  }
+}
+
 struct Node {
-  int id;
-  vector<Sink> sinks;
+  SinkSpan sinks;
   Node *leftChild;
   Node *rightChild;
-  string color;
-  int dieIndex;
+  Node *parent;
   double capacitance;
   double resistance;
+  double upstreamResistance; // From the timing source down to the parent
   double elmoreDelay;
-  bool isBuffered;
+  double bufferDelay;
+  int id;
   int x, y, z;
-  string node_type;
   int cluster_id;
-  double bufferDelay;
-  Node(const vector<Sink> &sinks, string color = "Gray",
+  int preorder;    // Preorder number, subtree is [preorder, preorderEnd)
+  int preorderEnd;
+  uint8_t dieIndex; // Index into dieColors, 0 (Gray) is uncolored
+  NodeType node_type;
+  bool isBuffered;
+  Node(SinkSpan sinks = SinkSpan(), NodeType node_type = NodeType::Undefined,
        double capacitance = 0.0, double resistance = 0.0,
        bool isBuffered = false, int id = 0, int x = -1, int y = -1, int z = -1,
-       string node_type = "undefined", int cluster_id = -1,
-       double bufferDelay = 0.0)
-      : id(id), sinks(sinks), leftChild(nullptr), rightChild(nullptr),
-        color(color), capacitance(capacitance), resistance(resistance),
-        isBuffered(isBuffered), x(x), y(y), z(z), node_type(node_type),
-        cluster_id(cluster_id), bufferDelay(bufferDelay) {}
+       int cluster_id = -1, double bufferDelay = 0.0, uint8_t dieIndex = 0)
+      : sinks(sinks), leftChild(nullptr), rightChild(nullptr),
+        parent(nullptr), capacitance(capacitance), resistance(resistance),
+        upstreamResistance(0.0), elmoreDelay(0.0), bufferDelay(bufferDelay),
+        id(id), x(x), y(y), z(z), cluster_id(cluster_id), preorder(-1),
+        preorderEnd(-1), dieIndex(dieIndex), node_type(node_type),
+        isBuffered(isBuffered) {}
+};
+
+// Allocates Nodes contiguously from large blocks and destroys all of them in
+// a single reset(), together with the sink arrays their spans point into.
+// Blocks are kept and reused after a reset
+class NodeArena {
+public:
+  explicit NodeArena(size_t blockSize = 4096)
+      : blockSize(blockSize), current(0), used(0) {}
+  NodeArena(const NodeArena &) = delete;
+  NodeArena &operator=(const NodeArena &) = delete;
+  ~NodeArena() {
+    reset();
+    for (Node *block : blocks) {
+      allocator<Node>().deallocate(block, blockSize);
+    }
+  }
+
+  template <typename... Args> Node *create(Args &&...args) {
+    if (current == blocks.size()) {
+      blocks.push_back(allocator<Node>().allocate(blockSize));
+    }
+    Node *node = new (blocks[current] + used) Node(forward<Args>(args)...);
+    if (++used == blockSize) {
+      current++;
+      used = 0;
+    }
+    return node;
+  }
+
+  // Takes a copy of sinks that lives until the next reset
+  vector<Sink> &adoptSinks(const vector<Sink> &sinks) {
+    sinkStores.emplace_back(new vector<Sink>(sinks));
+    return *sinkStores.back();
+  }
+
+  // Destroys every node and sink array handed out since the last reset
+  void reset() {
+    for (size_t b = 0; b <= current && b < blocks.size(); b++) {
+      size_t count = b < current ? blockSize : used;
+      for (size_t i = 0; i < count; i++) {
+        blocks[b][i].~Node();
+      }
+    }
+    current = used = 0;
+    sinkStores.clear();
+  }
+
+  size_t size() const { return current * blockSize + used; }
+
+private:
+  size_t blockSize; // Nodes per block
+  vector<Node *> blocks;
+  size_t current; // Block the next node goes into
+  size_t used;    // Nodes already placed in that block
+  vector<unique_ptr<vector<Sink>>> sinkStores;
 };
@@ -0,0 +1,308 @@
+#pragma once
+#include "clustering.hpp"
+#include "context.hpp"
+#include "dme.hpp"
+#include "globals.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "parallel.hpp"
+#include "structures.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
+#include "tree.hpp"
+#include "utilities.hpp"
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// One cluster subtree of a tier after zero skew synthesis
+struct ClusterSynthesis {
+  int clusterId;
+  vector<Sink> sinks; // Sinks the subtree was built over
+  Node *root;         // Zero skew subtree, its root is the cluster's MIV
+  Sink mivSink;       // That root as a sink for the tier above
+  int wirelength;     // Zero skew tree wirelength of the subtree
+  string log;         // Log lines written while synthesizing
+};
+
+// Builds the abstract tree over one cluster's sinks, embeds it with zero
+// skew merging and times it. Shares nothing with other clusters but the
+// context's atomic counters and node ids reserved ahead of time, so
+// clusters can run side by side
+ClusterSynthesis synthesizeCluster(SynthesisContext &ctx, int clusterId,
+                                   const vector<Sink> &subtreeSinks, int z,
+                                   int bound) {
+  ClusterSynthesis result;
+  result.clusterId = clusterId;
+  LOG_DEBUG("Printing subtree with Cluster ID: " << clusterId);
+  Point currMidpoint = getMidpointByClusterId(ctx, clusterId);
+  LOG_DEBUG("Cluster " << clusterId << " midpoint (" << currMidpoint.x << ","
+                       << currMidpoint.y << ")");
+  TraceSpan treeSpan(ctx.tracer, "AbsTreeGen3D");
+  treeSpan.arg("sinks", (long long)subtreeSinks.size());
+  Node *AbstractSubtree = AbsTreeGen3D(ctx, subtreeSinks, bound - 1);
+  treeSpan.stop();
+  LOG_DEBUG("***********************************");
+  assignPhysicalLocations(AbstractSubtree);
+  assignClusterIdToTree(AbstractSubtree, clusterId);
+  buildTiming(ctx, AbstractSubtree, ctx.tsvUnits.resistance);
+  // Merging moves merge points, which does not change the timing here, and
+  // sets buffers, which does. Only the buffered subtrees are retimed
+  vector<Node *> bufferedNodes;
+  TraceSpan mergeSpan(ctx.tracer, "zeroSkewTree");
+  Node *zeroSkewSubtree = zeroSkewTree(ctx, AbstractSubtree, &bufferedNodes);
+  zeroSkewSubtree->node_type = NodeType::MIV;
+  retimeBufferedNodes(ctx, bufferedNodes);
+  mergeSpan.stop();
+
+  // The subtree root goes up to the next tier as an MIV sink
+  Sink rootSink;
+  rootSink.x = zeroSkewSubtree->x;
+  rootSink.y = zeroSkewSubtree->y;
+  rootSink.z = z;
+  rootSink.delay = zeroSkewSubtree->elmoreDelay;
+  rootSink.cluster_id = zeroSkewSubtree->cluster_id;
+  rootSink.sink_type = SinkType::MIV;
+  result.root = zeroSkewSubtree;
+  result.mivSink = rootSink;
+  result.wirelength = calculateZeroSkewTreeWirelength(AbstractSubtree);
+  return result;
+}
+
+// Synthesizes the clusters with the given ids and sinks on up to
+// ctx.threads threads, largest cluster first. Each cluster gets the node ids
+// a serial run would give it and logs into its own buffer, and the results
+// come back in input order, so the output does not depend on the thread
+// count
+vector<ClusterSynthesis>
+synthesizeClusterSinks(SynthesisContext &ctx, const vector<int> &clusterIds,
+                       const vector<vector<Sink>> &clusterSinks, int z,
+                       int bound) {
+  size_t count = clusterIds.size();
+  vector<size_t> sizes(count);
+  vector<NodeRange> ranges(count);
+  for (size_t i = 0; i < count; i++) {
+    sizes[i] = clusterSinks[i].size();
+    // AbsTreeGen3D makes a full binary tree, one leaf per sink
+    ranges[i] = reserveNodes(ctx, 2 * (int)sizes[i] - 1);
+  }
+
+  ScopedTimer timer(ctx.metrics, Timer::ClusterSynthesis);
+  vector<ClusterSynthesis> results(count);
+  runLargestFirst(sizes, ctx.threads, [&](size_t i) {
+    ScopedTimer clusterTimer(ctx.metrics, Timer::SynthesizeCluster);
+    TraceSpan span(ctx.tracer, "cluster");
+    span.arg("cluster", clusterIds[i]).arg("sinks", (long long)sizes[i]);
+    NodeRangeScope nodes(ranges[i]);
+    ostringstream log;
+    ThreadLogScope logScope(log);
+    results[i] =
+        synthesizeCluster(ctx, clusterIds[i], clusterSinks[i], z, bound);
+    results[i].sinks = clusterSinks[i];
+    results[i].log = log.str();
+  });
+  return results;
+}
+
+// Synthesizes every cluster subtree of a tier, in clusterRoots order
+vector<ClusterSynthesis>
+synthesizeClusters(SynthesisContext &ctx, const vector<Node *> &clusterRoots,
+                   int z, int bound) {
+  vector<int> clusterIds;
+  vector<vector<Sink>> clusterSinks;
+  for (Node *clusterRoot : clusterRoots) {
+    clusterIds.push_back(clusterRoot->cluster_id);
+    clusterSinks.push_back(treeToSinkVector(clusterRoot));
+  }
+  return synthesizeClusterSinks(ctx, clusterIds, clusterSinks, z, bound);
+}
+
+// What a run leaves behind for ECO (eco.hpp) to work from: per tier the
+// clusters DBSCAN formed, each with its sinks and the MIV sink it passed up
+struct ClusterState {
+  int clusterId;
+  vector<Sink> sinks; // Empty once ECO removed every sink of the cluster
+  Sink mivSink;
+  int wirelength;
+  string exported; // The cluster's block of the tier export file
+};
+
+struct TierState {
+  int z;
+  int idealWirelength;
+  vector<ClusterState> clusters; // In export file order
+  unordered_map<int, pair<double, double>> midpoints;
+};
+
+struct DesignState {
+  int bound;
+  map<int, TierState> tiers;
+};
+
+// Synthesizes the design tier by tier, bottom up. The MIV sinks of each
+// tier's cluster subtrees join the sinks of the tier above
+DesignState synthesizeDesign(SynthesisContext &ctx, int bound) {
+  DesignState design;
+  design.bound = bound;
+  // Separate sinks by their z-coordinate, keeping input order within a
+  // tier. Tier sorted designs come grouped already
+  SinkSpan sinks = designSinks(ctx);
+  vector<Sink> grouped;
+  if (!ctx.sinksTierSorted) {
+    grouped.assign(sinks.begin(), sinks.end());
+    stable_sort(grouped.begin(), grouped.end(),
+                [](const Sink &a, const Sink &b) { return a.z < b.z; });
+    sinks = SinkSpan(grouped);
+  }
+  map<int, SinkSpan> sinksByZ;
+  for (Sink *first = sinks.begin(); first != sinks.end();) {
+    Sink *last = first;
+    while (last != sinks.end() && last->z == first->z) {
+      ++last;
+    }
+    if (!sinksByZ.emplace(first->z, SinkSpan(first, last)).second) {
+      throw runtime_error("Sinks marked tier sorted are not sorted by z");
+    }
+    first = last;
+  }
+  map<int, vector<Sink>> tierMIVSinks;
+
+  for (const auto &pair : sinksByZ) {
+    int z = pair.first;
+    vector<Sink> sinksGroup(pair.second.begin(), pair.second.end());
+    int tierZsmSum = 0;
+
+    // Add MIV sinks from lower tier (z-1) if they exist
+    if (z > 1 && tierMIVSinks.find(z - 1) != tierMIVSinks.end()) {
+      const auto &mivSinks = tierMIVSinks[z - 1];
+      sinksGroup.insert(sinksGroup.end(), mivSinks.begin(), mivSinks.end());
+    }
+
+    TraceSpan tierSpan(ctx.tracer, "tier");
+    tierSpan.arg("z", z).arg("sinks", (long long)sinksGroup.size());
+    TierState &tier = design.tiers[z];
+    tier.z = z;
+    ScopedTimer mstTimer(ctx.metrics, Timer::IdealWirelength);
+    TraceSpan mstSpan(ctx.tracer, "MST");
+    mstSpan.arg("sinks", (long long)sinksGroup.size());
+    tier.idealWirelength = calculateWirelength(sinksGroup);
+    mstSpan.stop();
+    mstTimer.stop();
+    ScopedTimer treeTimer(ctx.metrics, Timer::TierTree);
+    // For each z-coordinate, generate the tree and then perform zero skew tree
+    TraceSpan treeSpan(ctx.tracer, "AbsTreeGen3D");
+    treeSpan.arg("sinks", (long long)sinksGroup.size());
+    NodePoints dbscanPoints;
+    Node *root = AbsTreeGen3D(ctx, sinksGroup, bound - 1, &dbscanPoints);
+    treeSpan.stop();
+    root->z = z; // Assign the z coordinate of the sink group to the root node
+    LOG_DEBUG("\nProcessing z-coordinate: " << z);
+    // Create the tier-specific filename
+    string tierFilename = ctx.outputPrefix + "zeroskew_points_and_lines_z_" +
+                          to_string(z) + ".txt";
+    assignPhysicalLocations(root);
+    // assignPhysicalCharacteristics(root); WIP
+    treeTimer.stop();
+    // Baseline case, eps = layout.width, minPts=1 or numSinks
+    // double eps = layout.width * .085; // Epsilon distance
+    double eps = ctx.layout.width; // Epsilon distance
+    int minPts = 1;                // Minimum points to form a cluster
+    ScopedTimer dbscanTimer(ctx.metrics, Timer::DBSCAN);
+    TraceSpan dbscanSpan(ctx.tracer, "DBSCAN");
+    dbscanSpan.arg("z", z).arg("points", (long long)dbscanPoints.points.size());
+    runDBSCANAndAssignClusters(ctx, root, dbscanPoints, eps, minPts,
+                               bound - 1);
+    dbscanSpan.stop();
+    dbscanTimer.stop();
+    ScopedTimer midpointTimer(ctx.metrics, Timer::Midpoints);
+    ctx.clusterMidpoints = calculateClusterMidpoints(root);
+    tier.midpoints = ctx.clusterMidpoints;
+    midpointTimer.stop();
+    //  Create subtrees for each cluster
+    ScopedTimer subtreeTimer(ctx.metrics, Timer::ClusterSubtrees);
+    vector<Node *> clusterRoots = createClusterSubtrees(ctx, root);
+    subtreeTimer.stop();
+    if (logEnabled(LOG_LEVEL_DEBUG)) {
+      printNodesByClusterId(root);
+      calculateClusterMidpoints(root);
+    }
+    // Synthesize the cluster subtrees in parallel, then collect them in
+    // cluster order
+    vector<ClusterSynthesis> clusters =
+        synthesizeClusters(ctx, clusterRoots, z, bound);
+    ScopedTimer exportTimer(ctx.metrics, Timer::Export);
+    TierExporter exporter(tierFilename);
+    for (ClusterSynthesis &cluster : clusters) {
+      cout << cluster.log;
+      tierMIVSinks[z].push_back(cluster.mivSink);
+      if (logEnabled(LOG_LEVEL_DEBUG)) {
+        printTree(cluster.root);
+      }
+
+      int subtreeZsmWireLength = cluster.wirelength;
+      LOG_DEBUG("~~~Zero Skew Tree Wirelength for cluster "
+                << cluster.clusterId << ": " << subtreeZsmWireLength);
+      LOG_DEBUG("---------------------------------");
+      tierZsmSum += subtreeZsmWireLength;
+      LOG_DEBUG("subtreeZsmSum for z " << z << "=" << tierZsmSum);
+
+      // Export each subtree to the tier-specific file
+      TraceSpan exportSpan(ctx.tracer, "export");
+      exportSpan.arg("cluster", cluster.clusterId);
+      exporter.addSubtree(cluster.root);
+      exportSpan.stop();
+      LOG_DEBUG("Exported subtree for cluster " << cluster.clusterId
+                << " to tier " << z << " file");
+      tier.clusters.push_back({cluster.clusterId, std::move(cluster.sinks),
+                               cluster.mivSink, cluster.wirelength, ""});
+    }
+
+    exporter.flush();
+    exportTimer.stop();
+    LOG_DEBUG("Completed exporting all subtrees for tier " << z << " to "
+              << tierFilename);
+    // Frees the tier tree, the cluster subtrees and every zero skew subtree
+    releaseNodes(ctx);
+  }
+  return design;
+}
+
+// Sums of the per tier ideal (MST) and cluster zero skew tree wirelengths
+int idealWirelength(const DesignState &design) {
+  int sum = 0;
+  for (const auto &tier : design.tiers) {
+    sum += tier.second.idealWirelength;
+  }
+  return sum;
+}
+
+int zeroSkewWirelength(const DesignState &design) {
+  int sum = 0;
+  for (const auto &tier : design.tiers) {
+    for (const ClusterState &cluster : tier.second.clusters) {
+      sum += cluster.wirelength;
+    }
+  }
+  return sum;
+}
+
+// Logs the MIV sinks every tier passes up
+void printTierMIVSinks(const DesignState &design) {
+  for (const auto &tier : design.tiers) {
+    LOG_DEBUG("Tier " << tier.first << " subtree roots:");
+    for (const ClusterState &cluster : tier.second.clusters) {
+      if (cluster.sinks.empty()) {
+        continue;
+      }
+      const Sink &sink = cluster.mivSink;
+      LOG_DEBUG("Sink type: " << sinkTypeName(sink.sink_type) << "Cluster "
+                << sink.cluster_id << " at (" << sink.x << "," << sink.y
+                << ") with delay " << sink.delay);
+    }
+  }
+}
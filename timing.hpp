@@ -0,0 +1,128 @@
+#pragma once
+#include "context.hpp"
+#include "structures.hpp"
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// Incremental Elmore timing. Every node caches its downstream capacitance
+// (capacitance), the resistance above it (upstreamResistance) and its
+// elmoreDelay, the same values depthFirstCapacitance and depthFirstDelay
+// give. buildTiming fills the cache for a whole tree, the update functions
+// keep it current after a change by visiting only the nodes whose values
+// change, and the queries just read it
+
+// Capacitance a node drives: its own when buffered, its children's when
+// internal, its sinks' when a leaf. Summed in depthFirstCapacitance's order
+double localCapacitance(const Node *node) {
+  if (node->isBuffered) {
+    return node->capacitance;
+  }
+  double capacitance = 0.0;
+  if (node->leftChild)
+    capacitance += node->leftChild->capacitance;
+  if (node->rightChild)
+    capacitance += node->rightChild->capacitance;
+  if (!node->leftChild && !node->rightChild) {
+    for (const auto &sink : node->sinks) {
+      capacitance += sink.inputCapacitance;
+    }
+  }
+  return capacitance;
+}
+
+// Elmore delay of a node from its cached resistance and capacitance
+void refreshDelay(const SynthesisContext &ctx, Node *node) {
+  double delay = node->isBuffered ? ctx.bufferUnits.intrinsicDelay : 0.0;
+  node->elmoreDelay =
+      (node->upstreamResistance + node->resistance) * node->capacitance + delay;
+}
+
+// Capacitance is summed on the way up, delay needs the sum so it is set on
+// the way back
+double buildTimingSub(const SynthesisContext &ctx, Node *node,
+                      double upstreamResistance) {
+  node->upstreamResistance = upstreamResistance;
+  double totalResistance = upstreamResistance + node->resistance;
+  if (node->leftChild)
+    buildTimingSub(ctx, node->leftChild, totalResistance);
+  if (node->rightChild)
+    buildTimingSub(ctx, node->rightChild, totalResistance);
+  node->capacitance = localCapacitance(node);
+  refreshDelay(ctx, node);
+  return node->capacitance;
+}
+
+// Times a whole tree driven through sourceResistance in a single pass
+void buildTiming(const SynthesisContext &ctx, Node *root,
+                 double sourceResistance) {
+  if (root) {
+    buildTimingSub(ctx, root, sourceResistance);
+  }
+}
+
+// Updates the cache after the capacitance below node changed, a sink's or
+// a buffer's input. Only node and its ancestors drive the change, so the
+// walk follows the root path and stops at the first node whose capacitance
+// comes out the same, or at a buffer, which hides what it drives
+void updateCapacitance(const SynthesisContext &ctx, Node *node) {
+  for (; node; node = node->parent) {
+    double capacitance = localCapacitance(node);
+    bool unchanged = capacitance == node->capacitance;
+    node->capacitance = capacitance;
+    refreshDelay(ctx, node);
+    if (unchanged || node->isBuffered) {
+      return;
+    }
+  }
+}
+
+// Passes the resistance above node down its subtree
+void updateResistanceSub(const SynthesisContext &ctx, Node *node) {
+  refreshDelay(ctx, node);
+  double totalResistance = node->upstreamResistance + node->resistance;
+  for (Node *child : {node->leftChild, node->rightChild}) {
+    if (child && child->upstreamResistance != totalResistance) {
+      child->upstreamResistance = totalResistance;
+      updateResistanceSub(ctx, child);
+    }
+  }
+}
+
+// Updates the cache after node's own resistance changed, as when a buffer
+// is set there. The resistance lies above every node of the subtree, so
+// that is what gets visited, down to where the cached values already agree
+void updateResistance(const SynthesisContext &ctx, Node *node) {
+  if (node) {
+    updateResistanceSub(ctx, node);
+  }
+}
+
+// Brings the cache up to date after zero skew merging set buffers at nodes.
+// A merge leaves the buffer's input capacitance on its node for the merges
+// above to see, the tree is timed with what the node drives, as
+// buildTiming would. Subtrees inside another buffered subtree are covered
+// by it and skipped
+void retimeBufferedNodes(const SynthesisContext &ctx,
+                         const vector<Node *> &bufferedNodes) {
+  unordered_set<const Node *> buffered(bufferedNodes.begin(),
+                                       bufferedNodes.end());
+  for (Node *node : bufferedNodes) {
+    updateCapacitance(ctx, node);
+  }
+  for (Node *node : bufferedNodes) {
+    bool nested = false;
+    for (Node *up = node->parent; up && !nested; up = up->parent) {
+      nested = buffered.count(up) > 0;
+    }
+    if (!nested) {
+      updateResistance(ctx, node);
+    }
+  }
+}
+
+// Cached downstream capacitance of a node
+double timingCapacitance(const Node *node) { return node->capacitance; }
+
+// Cached Elmore delay from the tree's source to a node
+double timingDelay(const Node *node) { return node->elmoreDelay; }
@@ -0,0 +1,153 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+using namespace std;
+
+// Timeline of a run as Chrome trace events, for chrome://tracing or
+// ui.perfetto.dev. Tracing is off unless enabled, then every span is
+// recorded into a buffer of the thread that ran it, so threads never wait
+// on each other, and the buffers are written out once the run is over
+
+// One finished span with up to two integer arguments. Names are string
+// literals, nothing is formatted until the trace is written
+struct TraceEvent {
+  const char *name;
+  long long start;    // Nanoseconds since the tracer was enabled
+  long long duration; // Nanoseconds
+  const char *argNames[2];
+  long long argValues[2];
+  int argCount;
+};
+
+// The spans one thread recorded, tid numbers threads in the order they
+// first recorded
+struct TraceThread {
+  int tid;
+  vector<TraceEvent> events;
+};
+
+// Tells tracers apart in the per thread buffer cache, including one made
+// where an earlier one was destroyed
+atomic<unsigned long long> tracerCount{0};
+
+class Tracer {
+public:
+  Tracer() : id(++tracerCount) {}
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+
+  // Starts recording, span times count from here
+  void enable() {
+    origin = chrono::steady_clock::now();
+    enabled = true;
+  }
+  bool isEnabled() const { return enabled; }
+
+  long long now() const {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now() - origin)
+        .count();
+  }
+
+  // This thread's buffer, made the first time the thread asks. The last
+  // one asked for is cached per thread, so only a thread's first span
+  // takes the lock
+  TraceThread &threadBuffer() {
+    thread_local unsigned long long cachedTracer = 0;
+    thread_local TraceThread *cachedBuffer = nullptr;
+    if (cachedTracer != id) {
+      lock_guard<mutex> guard(lock);
+      threads.push_back(make_unique<TraceThread>());
+      threads.back()->tid = (int)threads.size();
+      cachedTracer = id;
+      cachedBuffer = threads.back().get();
+    }
+    return *cachedBuffer;
+  }
+
+  // Writes every recorded span as a trace event JSON object. Call once the
+  // threads that record have finished
+  void write(ostream &out) const {
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+           "\"tid\": 1, \"args\": {\"name\": \"mmm\"}}";
+    out << fixed << setprecision(3);
+    for (const unique_ptr<TraceThread> &thread : threads) {
+      out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+             "\"tid\": "
+          << thread->tid << ", \"args\": {\"name\": \"thread "
+          << thread->tid << "\"}}";
+      for (const TraceEvent &event : thread->events) {
+        // Trace event times are in microseconds
+        out << ",\n{\"name\": \"" << event.name
+            << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->tid
+            << ", \"ts\": " << event.start * 1e-3
+            << ", \"dur\": " << event.duration * 1e-3;
+        if (event.argCount > 0) {
+          out << ", \"args\": {";
+          for (int a = 0; a < event.argCount; a++) {
+            out << (a ? ", " : "") << '"' << event.argNames[a]
+                << "\": " << event.argValues[a];
+          }
+          out << '}';
+        }
+        out << '}';
+      }
+    }
+    out << "\n]}\n";
+  }
+
+private:
+  unsigned long long id;
+  bool enabled = false;
+  chrono::steady_clock::time_point origin;
+  mutex lock; // Guards threads
+  vector<unique_ptr<TraceThread>> threads;
+};
+
+// Records the time from construction to stop(), or to the end of the
+// scope, as a span on the calling thread. Does nothing but check a flag
+// while tracing is off
+class TraceSpan {
+public:
+  TraceSpan(Tracer &tracer, const char *name)
+      : tracer(tracer.isEnabled() ? &tracer : nullptr) {
+    if (this->tracer) {
+      buffer = &tracer.threadBuffer();
+      event.name = name;
+      event.argCount = 0;
+      event.start = tracer.now();
+    }
+  }
+  ~TraceSpan() { stop(); }
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  // Attaches an argument to the span, up to two
+  TraceSpan &arg(const char *name, long long value) {
+    if (tracer && event.argCount < 2) {
+      event.argNames[event.argCount] = name;
+      event.argValues[event.argCount] = value;
+      event.argCount++;
+    }
+    return *this;
+  }
+
+  void stop() {
+    if (tracer) {
+      event.duration = tracer->now() - event.start;
+      buffer->events.push_back(event);
+      tracer = nullptr;
+    }
+  }
+
+private:
+  Tracer *tracer;
+  TraceThread *buffer = nullptr;
+  TraceEvent event;
+};
@@ -1,17 +1,127 @@
 #pragma once
+#include "context.hpp"
+#include "logging.hpp"
+#include "parallel.hpp"
 #include "structures.hpp"
 #include "utilities.hpp"
 #include "globals.hpp"
+#include <sstream>
 #include <vector>
 #include <unordered_map>
 using namespace std;
 
+// Records a node in the id index so it can be looked up in constant time
+void registerNode(SynthesisContext &ctx, Node *node) {
+  if (node->id >= (int)ctx.nodeIndex.size()) {
+    ctx.nodeIndex.resize(node->id + 1, nullptr);
+  }
+  ctx.nodeIndex[node->id] = node;
+}
+
+// Block of node ids and an arena sized for them, reserved on the main
+// thread so that a cluster job can create its nodes on a worker thread
+struct NodeRange {
+  const SynthesisContext *owner;
+  NodeArena *arena;
+  int nextId;
+  int endId; // One past the last id
+};
+
+// Range createNode() draws from on this thread, null for the context's own
+// arena and id counter
+thread_local NodeRange *activeRange = nullptr;
+
+// Reserves the next count ids, in the order a serial run would hand them
+// out, with an arena in ctx.jobArenas that lives until releaseNodes()
+NodeRange reserveNodes(SynthesisContext &ctx, int count) {
+  ctx.jobArenas.emplace_back(new NodeArena(std::max(count, 1)));
+  int firstId = ctx.nodeID.fetch_add(count);
+  NodeRange range = {&ctx, ctx.jobArenas.back().get(), firstId,
+                     firstId + count};
+  // Sized up front, workers only ever write their own slots
+  if (range.endId > (int)ctx.nodeIndex.size()) {
+    ctx.nodeIndex.resize(range.endId, nullptr);
+  }
+  return range;
+}
+
+// While alive, createNode() on the constructing thread takes its nodes and
+// ids from range
+class NodeRangeScope {
+public:
+  explicit NodeRangeScope(NodeRange &range) : previous(activeRange) {
+    activeRange = &range;
+  }
+  ~NodeRangeScope() { activeRange = previous; }
+  NodeRangeScope(const NodeRangeScope &) = delete;
+  NodeRangeScope &operator=(const NodeRangeScope &) = delete;
+
+private:
+  NodeRange *previous;
+};
+
+// Range of ctx active on this thread, if any
+NodeRange *activeRangeOf(const SynthesisContext &ctx) {
+  return activeRange && activeRange->owner == &ctx ? activeRange : nullptr;
+}
+
+// Arena that nodes and abstract tree sink arrays of ctx go to on this thread
+NodeArena &currentArena(SynthesisContext &ctx) {
+  NodeRange *range = activeRangeOf(ctx);
+  return range ? *range->arena : ctx.nodeArena;
+}
+
+// Allocates a node in the arena with the next free id and records it in the
+// id index
+Node *createNode(SynthesisContext &ctx, SinkSpan sinks,
+                 NodeType type = NodeType::Undefined) {
+  int id;
+  NodeRange *range = activeRangeOf(ctx);
+  if (range) {
+    if (range->nextId == range->endId) {
+      throw runtime_error("Reserved node id range exhausted.");
+    }
+    id = range->nextId++;
+  } else {
+    id = ctx.nodeID++;
+  }
+  Node *node = currentArena(ctx).create(sinks, type, 0.0, 0.0, false, id);
+  registerNode(ctx, node);
+  return node;
+}
+
+// Frees every node and abstract tree sink array created since the last
+// call, including those of cluster jobs. Node pointers from before are
+// dangling afterwards
+void releaseNodes(SynthesisContext &ctx) {
+  ctx.nodeIndex.clear();
+  ctx.nodeArena.reset();
+  ctx.jobArenas.clear();
+}
+
+// Constant time lookup of a live node by its id
+Node *lookupNode(const SynthesisContext &ctx, int id) {
+  if (id < 0 || id >= (int)ctx.nodeIndex.size()) {
+    return nullptr;
+  }
+  return ctx.nodeIndex[id];
+}
+
+// Attaches both children to a node and points them back at it
+void setChildren(Node *node, Node *left, Node *right) {
+  node->leftChild = left;
+  node->rightChild = right;
+  if (left)
+    left->parent = node;
+  if (right)
+    right->parent = node;
+}
 
-Node *createClockSourceNode() {
-  Node *clockNode = new Node({}, "ClockSource", 0.0, 0.0, false, nodeID++);
-  clockNode->x = clockSource.x;
-  clockNode->y = clockSource.y;
-  clockNode->z = clockSource.z;
+Node *createClockSourceNode(SynthesisContext &ctx) {
+  Node *clockNode = createNode(ctx, {}, NodeType::ClockSource);
+  clockNode->x = ctx.clockSource.x;
+  clockNode->y = ctx.clockSource.y;
+  clockNode->z = ctx.clockSource.z;
   return clockNode;
 }
 
@@ -20,18 +130,50 @@ bool areCoordsNearlyIdentical(const Sink &s1, const Sink &s2,
   return abs(s1.x - s2.x) <= threshold && abs(s1.y - s2.y) <= threshold &&
          s1.z != s2.z; // Different layers
 }
-// Add this function to adjust coordinates
-vector<Sink> adjustNearlyIdenticalCoords(vector<Sink> sinks) {
+// Add this function to adjust coordinates, in place. Same result as
+// comparing every pair in order (for each sink, every later sink on another
+// tier within threshold moves by +1 in x and y), but sinks are hashed on
+// their current position so each one only looks at the cells around it.
+// Only ever moves the later sink of a pair, so sinks[0] keeps its position.
+// A moved sink can land within threshold of one it already passed, so a
+// second pass over the same sinks may move more
+void adjustNearlyIdenticalCoords(SinkSpan sinks, int threshold = 1) {
+  // Only sinks of different tiers are ever moved
+  bool oneTier = all_of(sinks.begin(), sinks.end(), [&](const Sink &sink) {
+    return sink.z == sinks.front().z;
+  });
+  if (oneTier) {
+    return;
+  }
+  unordered_map<long long, vector<int>> sinksAt;
+  for (size_t i = 0; i < sinks.size(); i++) {
+    sinksAt[cellKey(sinks[i].x, sinks[i].y)].push_back(i);
+  }
+  vector<int> moved;
   for (size_t i = 0; i < sinks.size(); i++) {
-    for (size_t j = i + 1; j < sinks.size(); j++) {
-      if (areCoordsNearlyIdentical(sinks[i], sinks[j])) {
-        // Offset the second sink by 1 unit in both x and y
-        sinks[j].x += 1;
-        sinks[j].y += 1;
+    moved.clear();
+    for (int dx = -threshold; dx <= threshold; dx++) {
+      for (int dy = -threshold; dy <= threshold; dy++) {
+        auto it = sinksAt.find(cellKey(sinks[i].x + dx, sinks[i].y + dy));
+        if (it == sinksAt.end())
+          continue;
+        for (int j : it->second) {
+          if (j > (int)i &&
+              areCoordsNearlyIdentical(sinks[i], sinks[j], threshold)) {
+            moved.push_back(j);
+          }
+        }
       }
     }
+    for (int j : moved) {
+      vector<int> &from = sinksAt[cellKey(sinks[j].x, sinks[j].y)];
+      from.erase(find(from.begin(), from.end(), j));
+      // Offset the second sink by 1 unit in both x and y
+      sinks[j].x += 1;
+      sinks[j].y += 1;
+      sinksAt[cellKey(sinks[j].x, sinks[j].y)].push_back(j);
+    }
   }
-  return sinks;
 }
 
 void extractSinks(Node *node, std::vector<Sink> &sinks) {
@@ -55,6 +197,35 @@ Node *findLCA(Node *root, int node1ID, int node2ID) {
     return root;
   return (leftLCA != nullptr) ? leftLCA : rightLCA;
 }
+// Number of parent links between a node and root, or -1 if root is not an
+// ancestor of the node
+int depthBelow(const Node *root, const Node *node) {
+  int depth = 0;
+  for (; node != nullptr; node = node->parent, depth++) {
+    if (node == root)
+      return depth;
+  }
+  return -1;
+}
+
+// Lowest common ancestor by walking parent links, O(depth) instead of a
+// search of the whole tree
+Node *findLCA(Node *root, Node *node1, Node *node2) {
+  int depth1 = depthBelow(root, node1);
+  int depth2 = depthBelow(root, node2);
+  if (depth1 < 0 || depth2 < 0)
+    return nullptr;
+  for (; depth1 > depth2; depth1--)
+    node1 = node1->parent;
+  for (; depth2 > depth1; depth2--)
+    node2 = node2->parent;
+  while (node1 != node2) {
+    node1 = node1->parent;
+    node2 = node2->parent;
+  }
+  return node1;
+}
+
 // Helper function to find a node by its ID
 Node *findNodeById(Node *node, int id) {
   if (node == nullptr)
@@ -89,6 +260,12 @@ int calculateManhattanDistance(Node *root, int id1, int id2) {
   // int z2 = node2->sinks.front().z;
   return abs(x2 - x1) + abs(y2 - y1); // Manhattan distance  + abs(z2 - z1)
 }
+
+// Same distance as above for nodes that are already at hand
+int calculateManhattanDistance(const Node *node1, const Node *node2) {
+  return abs(node2->sinks.front().x - node1->sinks.front().x) +
+         abs(node2->sinks.front().y - node1->sinks.front().y);
+}
 // Function to assign physical locations from the sink objects to their leaf
 // nodes
 void assignPhysicalLocations(Node *node) {
@@ -102,7 +279,7 @@ void assignPhysicalLocations(Node *node) {
       node->x = node->sinks.front().x;
       node->y = node->sinks.front().y;
       node->z = node->sinks.front().z;
-      node->node_type = "Leaf";
+      node->node_type = NodeType::Leaf;
     }
   }
 
@@ -121,7 +298,7 @@ void assignPhysicalCharacteristics(Node *node) {
       node->x = node->sinks.front().x;
       node->y = node->sinks.front().y;
       node->z = node->sinks.front().z;
-      node->node_type = "Leaf";
+      node->node_type = NodeType::Leaf;
 
       node->capacitance = node->sinks.front().capacitance;
       // Assign delay from sink to node
@@ -170,7 +347,8 @@ double depthFirstCapacitance(Node *node) {
   return nodeCapacitance;
 }
 
-void depthFirstDelay(Node *node, double accumulatedResistance) {
+void depthFirstDelay(const SynthesisContext &ctx, Node *node,
+                     double accumulatedResistance) {
   if (!node)
     return; // Base case: node is null
 
@@ -182,7 +360,7 @@ void depthFirstDelay(Node *node, double accumulatedResistance) {
   // calculation
   if (node->isBuffered) {
     // if buffered, intrinsicdelay=17000 fS
-    delay = bufferUnits.intrinsicDelay; //+(bufferUnits.outputResistance *
+    delay = ctx.bufferUnits.intrinsicDelay; //+(bufferUnits.outputResistance *
                                         // node->capacitance);
   }
 
@@ -197,15 +375,15 @@ void depthFirstDelay(Node *node, double accumulatedResistance) {
   // Recursively calculate delay for child nodes, passing the total accumulated
   // resistance to each child
   if (node->leftChild)
-    depthFirstDelay(node->leftChild, totalResistance);
+    depthFirstDelay(ctx, node->leftChild, totalResistance);
   if (node->rightChild)
-    depthFirstDelay(node->rightChild, totalResistance);
+    depthFirstDelay(ctx, node->rightChild, totalResistance);
 }
 
 // Function to calculate hierarchical delay for the entire tree
-void hierarchicalDelay(Node *node) {
+void hierarchicalDelay(const SynthesisContext &ctx, Node *node) {
   depthFirstCapacitance(node);
-  depthFirstDelay(node, clockSource.outputResistance);
+  depthFirstDelay(ctx, node, ctx.clockSource.outputResistance);
 }
 
 double getNodeCapacitance(Node *node, int id) {
@@ -242,133 +420,272 @@ double distance(const Point &a, const Point &b) {
 
 // Core Logic
 
+// Splits S in place into the sinks inTop holds for (St) and the rest (Sb),
+// keeping the relative order inside each group. The group holding S's first
+// sink goes first, so a node and the child that inherits its first sink both
+// start at the same place in the array
+template <typename Predicate>
+void partitionSinks(SinkSpan S, Predicate inTop, SinkSpan &St, SinkSpan &Sb) {
+  if (S.empty()) {
+    St = Sb = S;
+    return;
+  }
+  bool frontInTop = inTop(S.front());
+  Sink *mid = std::stable_partition(S.begin(), S.end(), [&](const Sink &sink) {
+    return inTop(sink) == frontInTop;
+  });
+  SinkSpan head(S.begin(), mid), tail(mid, S.end());
+  St = frontInTop ? head : tail;
+  Sb = frontInTop ? tail : head;
+}
+
 // Function to perform Z-cut
-void Zcut(const vector<Sink> &S, const ClockSource &Zs, vector<Sink> &St,
-          vector<Sink> &Sb) {
-  cout << endl;
-  cout << "Z-cut!" << endl;
-  int Zmin = getMinZ(S); // Set your Zmin value
-  int Zmax = getMaxZ(S); // Set your Zmax value
+void Zcut(SynthesisContext &ctx, SinkSpan S, const ClockSource &Zs,
+          SinkSpan &St, SinkSpan &Sb) {
+  LOG_TRACE("");
+  LOG_TRACE("Z-cut!");
+  SinkBounds bounds = getBounds(S);
+  int Zmin = bounds.minZ; // Set your Zmin value
+  int Zmax = bounds.maxZ; // Set your Zmax value
   //  If Zs is less than or equal to Zmin
   if (Zs.z <= Zmin) {
-    cout << "Zs is less than or equal to Zmin" << endl;
-    // if (!S.empty()) {
-    for (const auto &sink : S) {
-      if (sink.z == Zmin) {
-        Sb.push_back(sink);
-      } else {
-        St.push_back(sink);
-      }
-    }
-    //}
+    LOG_TRACE("Zs is less than or equal to Zmin");
+    partitionSinks(
+        S, [&](const Sink &sink) { return sink.z != Zmin; }, St, Sb);
   }
   // If Zs is greater than or equal to Zmax
   else if (Zs.z >= Zmax) {
-    cout << "If Zs is greater than or equal to Zmax" << endl;
-    for (const auto &sink : S) {
-      if (sink.z == Zmax) {
-        St.push_back(sink);
-      } else {
-        Sb.push_back(sink);
-      }
-    }
-    //}
+    LOG_TRACE("If Zs is greater than or equal to Zmax");
+    partitionSinks(
+        S, [&](const Sink &sink) { return sink.z == Zmax; }, St, Sb);
   }
   // If Zs is between Zmin and Zmax
   else {
-    cout << "If Zs is between Zmin and Zmax" << endl;
-    for (const auto &sink : S) {
-      if (sink.z >= Zs.z) {
-        St.push_back(sink); // S top
-      } else {
-        Sb.push_back(sink); // S bottom
-      }
-    }
+    LOG_TRACE("If Zs is between Zmin and Zmax");
+    partitionSinks(
+        S, [&](const Sink &sink) { return sink.z >= Zs.z; }, St, Sb);
   }
-  zCutCount++;
-}
-
-// Abstract Tree Generation
-Node *AbsTreeGen3D(const vector<Sink> &S, int B) {
-  // fixes edge case, where points are too close together to partition
-  vector<Sink> adjustedSinks = adjustNearlyIdenticalCoords(S);
-  int B1 = 0;
-  int B2 = 0;
-  // int deltaX = getMaxX(S) - getMinX(S);
-  // int deltaY = getMaxY(S) - getMinY(S);
-  // int deltaZ = getMaxZ(S) - getMinZ(S);
-  // fixes edge case, where points are too close together to partition
-  int deltaX = getMaxX(adjustedSinks) - getMinX(adjustedSinks);
-  int deltaY = getMaxY(adjustedSinks) - getMinY(adjustedSinks);
-  int deltaZ = getMaxZ(adjustedSinks) - getMinZ(adjustedSinks);
-  vector<Sink> St, Sb;
-  ClockSource Zs = clockSource;
-  if (adjustedSinks.size() == 1) {
-    // Base case: if die span = 1, 2d tree
-    return new Node(S, "Gray", 0.0, 0.0, false,
-                    nodeID++); // Assign a unique id to the node
+  ctx.metrics.add(Counter::ZCuts);
+}
 
-    //} else if (deltaZ > 1 && B==1) {
+// Splits S, of at least two sinks, into the sink groups of the left (St)
+// and right (Sb) child and their buffer bounds B1 and B2
+void splitAbsTreeSinks(SynthesisContext &ctx, SinkSpan S, int B,
+                       SinkSpan &St, SinkSpan &Sb, int &B1, int &B2) {
+  B1 = 0;
+  B2 = 0;
+  SinkBounds bounds = getBounds(S);
+  int deltaX = bounds.maxX - bounds.minX;
+  int deltaY = bounds.maxY - bounds.minY;
+  int deltaZ = bounds.maxZ - bounds.minZ;
+  ClockSource Zs = ctx.clockSource;
+  if (deltaX == 0 && deltaY == 0 && deltaZ == 0) {
+    // Coincident sinks have no cut to tell them apart and are split by their
+    // order in S. They come from duplicate sinks of one tier in the input,
+    // and from adjustNearlyIdenticalCoords when it moves a sink onto one it
+    // already passed
+    LOG_TRACE("Special case: All coordinates are the same. Splitting the "
+              "sinks in half.");
+    Sink *middle = S.begin() + S.size() / 2;
+    St = SinkSpan(S.begin(), middle);
+    Sb = SinkSpan(middle, S.end());
+    B1 = B / 2;
+    B2 = B - B1;
   } else if (deltaX == 0 && deltaY == 0 && deltaZ >= 1) {
     // New condition for the edge case where all x and y are the same, but z
     // differs
-    cout << "Special case: All x and y coordinates are the same. Performing "
-            "Z-cut based on z coordinates."
-         << endl;
-    Zcut(adjustedSinks, Zs, St, Sb);
+    LOG_TRACE("Special case: All x and y coordinates are the same. Performing "
+              "Z-cut based on z coordinates.");
+    Zcut(ctx, S, Zs, St, Sb);
   } else if (deltaZ >= 1 && B == 1) {
-    Zcut(adjustedSinks, Zs, St, Sb);
+    Zcut(ctx, S, Zs, St, Sb);
     //  Display St and Sb
-    cout << "St (Top most die group):" << endl;
+    LOG_TRACE("St (Top most die group):");
     for (const auto &sink : St) {
-      cout << "(" << sink.x << "," << sink.y << "," << sink.z
-           << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance << " fF"
-           << endl;
+      LOG_TRACE("(" << sink.x << "," << sink.y << "," << sink.z
+                << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance
+                << " fF");
     }
-    cout << "Sb (Bottom most die group):" << endl;
+    LOG_TRACE("Sb (Bottom most die group):");
     for (const auto &sink : Sb) {
-      cout << "(" << sink.x << "," << sink.y << "," << sink.z
-           << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance << " fF"
-           << endl;
+      LOG_TRACE("(" << sink.x << "," << sink.y << "," << sink.z
+                << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance
+                << " fF");
     }
     B1 = B2 = 1;
 
   } else {
-    int medianX = calculateMedianX(adjustedSinks);
-    int medianY = calculateMedianY(adjustedSinks);
-    for (const auto &sink : adjustedSinks) {
-      if (deltaX > deltaY) {
-        if (sink.x < medianX) {
-          St.push_back(sink); // top subset
-        } else {
-          Sb.push_back(sink); // bottom subset
-        }
-      } else {
-        if (sink.y < medianY) {
-          St.push_back(sink); // top subset
-        } else {
-          Sb.push_back(sink); // bottom subset
-        }
-      }
-    }
+    // Only the median of the wider axis is needed. Sinks on the median go
+    // with those below it, unless none are below, as when the median is
+    // the smallest coordinate of the axis, so neither side comes out empty
+    int Sink::*axis = deltaX > deltaY ? &Sink::x : &Sink::y;
+    int median = calculateMedian(S, axis);
+    bool anyBelow = any_of(S.begin(), S.end(), [&](const Sink &sink) {
+      return sink.*axis < median;
+    });
+    partitionSinks(
+        S,
+        [&](const Sink &sink) {
+          return anyBelow ? sink.*axis < median : sink.*axis <= median;
+        },
+        St, Sb);
     B1 = B / 2;
     B2 = B - B1;
   }
-  Node *root = new Node(S, "Gray", 0.0, 0.0, false,
-                        nodeID++); // Assign a unique id to the node
+}
+
+// The DBSCAN input of a tier tree: the positions of the sinks of every node
+// as the node was reached, in preorder and in input order within a node.
+// Each position is kept once, where it first came, with the number of
+// times it came. DBSCAN weighs a position by that count, which labels it as
+// the list with every repeat written out would, in memory for one entry per
+// position rather than one per sink and tree level
+struct NodePoints {
+  vector<Point> points;
+  vector<int> weights;                   // Times each point came
+  unordered_map<long long, int> indexOf; // cellKey(x, y) -> index in points
+};
+
+void addNodePoint(NodePoints &nodePoints, int x, int y, int weight) {
+  auto found = nodePoints.indexOf.emplace(cellKey(x, y),
+                                          (int)nodePoints.points.size());
+  if (found.second) {
+    nodePoints.points.push_back({(double)x, (double)y, 0});
+    nodePoints.weights.push_back(weight);
+  } else {
+    nodePoints.weights[found.first->second] += weight;
+  }
+}
+
+// Adds the positions of S to nodePoints, when given. Called as a node's
+// range is reached, before it is partitioned, so a node's sinks come in the
+// order of the tree's input
+void recordNodePoints(NodePoints *nodePoints, SinkSpan S) {
+  if (nodePoints) {
+    for (const Sink &sink : S) {
+      addNodePoint(*nodePoints, sink.x, sink.y, 1);
+    }
+  }
+}
+
+// Adds the points another thread recorded for a later part of the tree, as
+// if they had been recorded into nodePoints
+void appendNodePoints(NodePoints &nodePoints, const NodePoints &later) {
+  for (size_t i = 0; i < later.points.size(); i++) {
+    addNodePoint(nodePoints, (int)later.points[i].x, (int)later.points[i].y,
+                 later.weights[i]);
+  }
+}
 
-  root->leftChild = AbsTreeGen3D(St, B1);
-  root->rightChild = AbsTreeGen3D(Sb, B2);
+// Abstract Tree Generation over S, a range of the tree's sink array that is
+// partitioned in place. Nodes keep [first, last) of their range
+Node *AbsTreeGen3DSub(SynthesisContext &ctx, SinkSpan S, int B,
+                      NodePoints *nodePoints) {
+  recordNodePoints(nodePoints, S);
+  // fixes edge case, where points are too close together to partition.
+  // Every level offsets its own range again, so sinks an offset left close
+  // together are separated once they share a range
+  adjustNearlyIdenticalCoords(S);
+  if (S.size() == 1) {
+    // Base case: if die span = 1, 2d tree
+    return createNode(ctx, S); // Assign a unique id to the node
+  }
+  SinkSpan St, Sb;
+  int B1, B2;
+  splitAbsTreeSinks(ctx, S, B, St, Sb, B1, B2);
+  Node *root = createNode(ctx, S); // Assign a unique id to the node
+
+  Node *left = AbsTreeGen3DSub(ctx, St, B1, nodePoints);
+  Node *right = AbsTreeGen3DSub(ctx, Sb, B2, nodePoints);
+  setChildren(root, left, right);
   return root;
 }
 
-// Function to delete the tree nodes recursively
-void deleteTree(Node *node) {
-  if (node) {
-    deleteTree(node->leftChild);
-    deleteTree(node->rightChild);
-    delete node;
+// Sink groups below this size are split on the thread that reached them
+const size_t absTreeParallelGrain = 4096;
+
+// Topology half of the parallel builder. The serial builder numbers nodes in
+// preorder, so the node for S gets id base + offset, its left child
+// base + offset + 1 and its right child base + offset + 2 * |St|. spans
+// records every node's sink group at its offset. The two children of a large
+// group are split on two threads while budget allows, each logging and
+// recording node points into its own buffers so both read as in a serial run
+void planAbsTreeSub(SynthesisContext &ctx, SinkSpan S, int B,
+                    vector<SinkSpan> &spans, size_t offset, unsigned budget,
+                    NodePoints *nodePoints) {
+  spans[offset] = S;
+  recordNodePoints(nodePoints, S);
+  adjustNearlyIdenticalCoords(S); // As in AbsTreeGen3DSub
+  if (S.size() == 1) {
+    return;
+  }
+  SinkSpan St, Sb;
+  int B1, B2;
+  splitAbsTreeSinks(ctx, S, B, St, Sb, B1, B2);
+  size_t leftOffset = offset + 1;
+  size_t rightOffset = offset + 2 * St.size();
+  if (budget <= 1 || S.size() < absTreeParallelGrain) {
+    planAbsTreeSub(ctx, St, B1, spans, leftOffset, 1, nodePoints);
+    planAbsTreeSub(ctx, Sb, B2, spans, rightOffset, 1, nodePoints);
+    return;
+  }
+  ostringstream leftLog, rightLog;
+  NodePoints leftPoints, rightPoints;
+  forkJoin(
+      budget,
+      [&](unsigned share) {
+        ThreadLogScope log(leftLog);
+        planAbsTreeSub(ctx, St, B1, spans, leftOffset, share,
+                       nodePoints ? &leftPoints : nullptr);
+      },
+      [&](unsigned share) {
+        ThreadLogScope log(rightLog);
+        planAbsTreeSub(ctx, Sb, B2, spans, rightOffset, share,
+                       nodePoints ? &rightPoints : nullptr);
+      });
+  logStream() << leftLog.str() << rightLog.str();
+  if (nodePoints) {
+    appendNodePoints(*nodePoints, leftPoints);
+    appendNodePoints(*nodePoints, rightPoints);
+  }
+}
+
+// Same tree, node ids included, as AbsTreeGen3DSub, with the splitting done
+// on up to budget threads. The nodes themselves are then created in
+// preorder on the calling thread, which is cheap next to the splitting
+Node *AbsTreeGen3DParallel(SynthesisContext &ctx, SinkSpan S, int B,
+                           unsigned budget, NodePoints *nodePoints) {
+  vector<SinkSpan> spans(2 * S.size() - 1);
+  planAbsTreeSub(ctx, S, B, spans, 0, budget, nodePoints);
+  vector<Node *> nodes(spans.size());
+  for (size_t k = 0; k < spans.size(); k++) {
+    nodes[k] = createNode(ctx, spans[k]);
+  }
+  for (size_t k = 0; k < spans.size(); k++) {
+    if (spans[k].size() > 1) {
+      size_t leftSize = spans[k + 1].size();
+      setChildren(nodes[k], nodes[k + 1], nodes[k + 2 * leftSize]);
+    }
+  }
+  return nodes[0];
+}
+
+// Builds the abstract tree over one private copy of S that all of its nodes
+// share. The copy lives in the node arena along with the nodes. Creates
+// exactly 2 * S.size() - 1 nodes. Large trees are split on ctx.threads
+// threads, with the same result as a serial build. nodePoints, when given,
+// receives the sinks of every node in preorder, each node's in the order of
+// S, as they were when the node was reached. Partitioning in place reorders
+// the nodes' spans afterwards, so this is the way to read them in input
+// order
+Node *AbsTreeGen3D(SynthesisContext &ctx, const vector<Sink> &S, int B,
+                   NodePoints *nodePoints = nullptr) {
+  SinkSpan all(currentArena(ctx).adoptSinks(S));
+  unsigned budget = availableThreads(ctx.threads);
+  if (budget > 1 && all.size() >= absTreeParallelGrain) {
+    return AbsTreeGen3DParallel(ctx, all, B, budget, nodePoints);
   }
+  return AbsTreeGen3DSub(ctx, all, B, nodePoints);
 }
 
 void printTree(Node *node, int level = 0) {
@@ -382,22 +699,22 @@ void printTree(Node *node, int level = 0) {
   }
   // Print the current node along with its color, memory address, capacitance,
   // and Elmore delay.
-  cout << indent << node->node_type << " Node ID: " << node->id
+  cout << indent << nodeTypeName(node->node_type) << " Node ID: " << node->id
        << " Cluster ID: " << node->cluster_id << " at position: (" << node->x
        << ", " << node->y << ", " << node->z << ") -  Depth " << level
-       << " - Color: " << node->color
+       << " - Color: " << dieColorName(node->dieIndex)
        << " - Total Capacitance: " << node->capacitance << " fF"
-       << " - Elmore Delay: " << node->elmoreDelay << " fs" << endl;
+       << " - Elmore Delay: " << node->elmoreDelay << " fs" << '\n';
 
   // If the node is a leaf, also print its sinks.
   if (!node->leftChild && !node->rightChild) {
     for (const auto &sink : node->sinks) {
       cout << indent << "    Sink: (" << sink.x << ", " << sink.y << ", "
            << sink.z << "), Input Capacitance: " << sink.inputCapacitance
-           << " fF, Color: " << sink.color << endl;
+           << " fF, Color: " << dieColorName(sink.dieIndex) << '\n';
     }
   }
-  cout << endl;
+  cout << '\n';
   if (node->rightChild) {
     printTree(node->rightChild, level + 1);
   }
@@ -409,7 +726,7 @@ void printLeaves(const Node *node) {
   }
   if (node->leftChild == nullptr && node->rightChild == nullptr) {
     for (const auto &sink : node->sinks) {
-      cout << "Color: " << sink.color
+      cout << "Color: " << dieColorName(sink.dieIndex)
            << " - Sink: ("
               "Leaf Nodes(Sinks):  ("
            << sink.x << ", " << sink.y << ", " << sink.z << ")" << endl;
@@ -426,29 +743,29 @@ void colorTree(Node *node, const vector<string> &dieColors,
     return;
   }
   // Determine the color of the source based on its z-coordinate
-  string sourceColor = dieColors[source.z % dieColors.size()];
+  int sourceColor = source.z % dieColors.size();
 
   if (depth == 0) { // If the node is the root
-    node->color = sourceColor;
+    node->dieIndex = sourceColor;
   } else {
     int Zmin = getMinZ(node->sinks);
     int Zmax = getMaxZ(node->sinks);
     if (Zmin > source.z) {
       // If Zmin is greater than the z-coordinate of the source, set to the
       // color of Zmin
-      node->color = dieColors[Zmin % dieColors.size()];
+      node->dieIndex = Zmin % dieColors.size();
     } else if (Zmax < source.z) {
       // If Zmax is less than the z-coordinate of the source, set to the color
       // of Zmax
-      node->color = dieColors[Zmax % dieColors.size()];
+      node->dieIndex = Zmax % dieColors.size();
     } else {
       // Otherwise, set to the color of the source
-      node->color = sourceColor;
+      node->dieIndex = sourceColor;
     }
   }
   // Assign colors to the sinks within this node
   for (auto &sink : node->sinks) {
-    sink.color = node->color;
+    sink.dieIndex = node->dieIndex;
   }
   colorTree(node->leftChild, dieColors, source, depth + 1);
   colorTree(node->rightChild, dieColors, source, depth + 1);
@@ -499,8 +816,9 @@ Node *findNodeByChildren(Node *root, int childX, int childY) {
        << endl;
   return findNodeByChildren(root->rightChild, childX, childY);
 }
-// Function to find the minimum spanning tree using Prim's algorithm
-int calculateWirelength(const vector<Sink> &sinks) {
+// Function to find the minimum spanning tree using Prim's algorithm. Dense
+// O(n^2) reference for calculateWirelength
+int calculateWirelengthPrim(const vector<Sink> &sinks) {
   int n = sinks.size();
   if (n == 0)
     return 0;
@@ -538,6 +856,93 @@ int calculateWirelength(const vector<Sink> &sinks) {
   }
   return totalWirelength;
 }
+
+struct MSTEdge {
+  int length;
+  int u, v;
+};
+
+// Candidate edges of the rectilinear MST: for every point, its nearest
+// neighbour in each octant, found with four sweeps over rotated/reflected
+// copies of the points. At most 4n edges, O(n log n) total
+vector<MSTEdge> rectilinearMSTCandidates(const vector<Sink> &sinks) {
+  int n = sinks.size();
+  vector<int> xs(n), ys(n), order(n);
+  for (int i = 0; i < n; ++i) {
+    xs[i] = sinks[i].x;
+    ys[i] = sinks[i].y;
+    order[i] = i;
+  }
+  vector<MSTEdge> edges;
+  edges.reserve(4 * n);
+  for (int pass = 0; pass < 4; ++pass) {
+    sort(order.begin(), order.end(), [&](int i, int j) {
+      return xs[i] - xs[j] < ys[j] - ys[i];
+    });
+    // Points still waiting for their nearest neighbour, keyed on -y
+    map<int, int> active;
+    for (int i : order) {
+      for (auto it = active.lower_bound(-ys[i]); it != active.end();
+           active.erase(it++)) {
+        int j = it->second;
+        int dx = xs[i] - xs[j];
+        int dy = ys[i] - ys[j];
+        if (dy > dx)
+          break;
+        edges.push_back({dx + dy, i, j});
+      }
+      active[-ys[i]] = i;
+    }
+    for (int i = 0; i < n; ++i) {
+      if (pass & 1) {
+        xs[i] = -xs[i];
+      } else {
+        swap(xs[i], ys[i]);
+      }
+    }
+  }
+  return edges;
+}
+
+int findSet(vector<int> &setOf, int i) {
+  while (setOf[i] != i) {
+    setOf[i] = setOf[setOf[i]];
+    i = setOf[i];
+  }
+  return i;
+}
+
+// Rectilinear MST length: octant sweep candidates followed by Kruskal,
+// O(n log n). Reports the same total as the Prim reference, which can be
+// selected with usePrim to cross-check
+int calculateWirelength(const vector<Sink> &sinks, bool usePrim = false) {
+  if (usePrim)
+    return calculateWirelengthPrim(sinks);
+  int n = sinks.size();
+  if (n == 0)
+    return 0;
+  vector<MSTEdge> edges = rectilinearMSTCandidates(sinks);
+  sort(edges.begin(), edges.end(), [](const MSTEdge &a, const MSTEdge &b) {
+    return a.length < b.length;
+  });
+  vector<int> setOf(n);
+  for (int i = 0; i < n; ++i)
+    setOf[i] = i;
+  int totalWirelength = 0;
+  int joined = 1;
+  for (const MSTEdge &edge : edges) {
+    int a = findSet(setOf, edge.u);
+    int b = findSet(setOf, edge.v);
+    if (a == b)
+      continue;
+    setOf[a] = b;
+    totalWirelength += edge.length;
+    if (++joined == n)
+      break;
+  }
+  return totalWirelength;
+}
+
 int calculateZeroSkewTreeWirelength(Node *root) {
   if (!root)
     return 0.0;
@@ -577,12 +982,12 @@ void printNodesByClusterId(Node *root) {
     int clusterId = cluster.first;
     const auto &nodes = cluster.second;
 
-    std::cout << "Cluster ID: " << clusterId << std::endl;
+    std::cout << "Cluster ID: " << clusterId << '\n';
     for (const auto &node : nodes) {
       std::cout << "Node ID: " << node->id << ", Position: (" << node->x << ", "
-                << node->y << ", " << node->z << ")" << std::endl;
+                << node->y << ", " << node->z << ")" << '\n';
     }
-    std::cout << std::endl;
+    std::cout << '\n';
   }
 }
 
@@ -623,9 +1028,8 @@ calculateClusterMidpoints(Node *root) {
     if (count > 0) {
       double midpointX = sumX / count;
       double midpointY = sumY / count;
-      std::cout << "Cluster ID: " << clusterId << ", Midpoint: ("
-                << ceil(midpointX) << ", " << floor(midpointY) << ")"
-                << std::endl;
+      LOG_DEBUG("Cluster ID: " << clusterId << ", Midpoint: ("
+                << ceil(midpointX) << ", " << floor(midpointY) << ")");
       // Store the midpoint in the map
       clusterMidpoints[clusterId] = {ceil(midpointX), floor(midpointY)};
     }
@@ -633,13 +1037,14 @@ calculateClusterMidpoints(Node *root) {
 
   return clusterMidpoints; // Return the map of midpoints
 }
-Node *createClusterSubtree(const std::vector<Node *> &clusterNodes) {
+Node *createClusterSubtree(SynthesisContext &ctx,
+                           const std::vector<Node *> &clusterNodes) {
   if (clusterNodes.empty()) {
     return nullptr;
   }
 
   // Create a new root node for this cluster
-  Node *clusterRoot = new Node({}, "ClusterRoot", 0.0, 0.0, false, nodeID++);
+  Node *clusterRoot = createNode(ctx, {}, NodeType::ClusterRoot);
   clusterRoot->cluster_id = clusterNodes[0]->cluster_id;
 
   // Calculate the average position for the cluster root
@@ -668,20 +1073,21 @@ Node *createClusterSubtree(const std::vector<Node *> &clusterNodes) {
     }
   }
 
-  clusterRoot->leftChild = createClusterSubtree(leftNodes);
-  clusterRoot->rightChild = createClusterSubtree(rightNodes);
+  Node *left = createClusterSubtree(ctx, leftNodes);
+  Node *right = createClusterSubtree(ctx, rightNodes);
+  setChildren(clusterRoot, left, right);
 
   return clusterRoot;
 }
 
-std::vector<Node *> createClusterSubtrees(Node *root) {
+std::vector<Node *> createClusterSubtrees(SynthesisContext &ctx, Node *root) {
   std::map<int, std::vector<Node *>> clusters;
   collectNodesByClusterId(root, clusters);
 
   std::vector<Node *> clusterRoots;
   for (const auto &cluster : clusters) {
     if (cluster.first != -1) { // Ignore noise points (cluster ID -1)
-      Node *clusterRoot = createClusterSubtree(cluster.second);
+      Node *clusterRoot = createClusterSubtree(ctx, cluster.second);
       clusterRoots.push_back(clusterRoot);
     }
   }
@@ -722,11 +1128,10 @@ void printMidpointById(
     std::cout << "Cluster ID " << clusterId << " not found." << std::endl;
   }
 }
-// Global variable to store midpoints
-std::unordered_map<int, std::pair<double, double>> clusterMidpoints;
-Point getMidpointByClusterId(int clusterId) {
-  auto it = clusterMidpoints.find(clusterId);
-  if (it != clusterMidpoints.end()) {
+// Midpoint of a cluster of the tier ctx is working on
+Point getMidpointByClusterId(const SynthesisContext &ctx, int clusterId) {
+  auto it = ctx.clusterMidpoints.find(clusterId);
+  if (it != ctx.clusterMidpoints.end()) {
     return Point{it->second.first, it->second.second};
   }
   // Return a default Point or throw an exception if the cluster ID is not found
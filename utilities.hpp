@@ -1,18 +1,28 @@
 #pragma once
 #include "structures.hpp"
+#include "context.hpp"
 #include "globals.hpp"
+#include "logging.hpp"
+#include "parser.hpp"
 #include <iostream>     // for cout, cerr
 #include <vector>       // for vector<>
 #include <string>       // for string
 #include <cmath>        // for abs, floor, ceil
 #include <algorithm>    // for max_element, min_element
+#include <charconv>     // for to_chars
 #include <limits>       // for numeric_limits
 #include <fstream>      // for file operations
 #include <map>
 #include <set>
+#include <unordered_map>
 using namespace std;
 
 // Utility Functions
+// Name of the color a die index stands for
+const string &dieColorName(int dieIndex) {
+  return dieColors[dieIndex % dieColors.size()];
+}
+
 // Function to calculate the Manhattan distance between two sinks
 int manhattanDistance(const Sink &a, const Sink &b) {
   return abs(a.x - b.x) + abs(a.y - b.y);
@@ -58,43 +68,66 @@ vector<Point> filterPoints(const vector<Point> &points, double minDistance) {
 
 
 
-// Function to calculate the median of x coordinates
-int calculateMedianX(const vector<Sink> &sinks) {
-  vector<int> xCoordinates;
-  xCoordinates.reserve(sinks.size()); // Pre-allocate for efficiency
+// Median of one coordinate (axis is &Sink::x or &Sink::y) by linear-time
+// selection. For an even count the middle two are averaged, as before
+int calculateMedian(SinkSpan sinks, int Sink::*axis) {
+  vector<int> coordinates;
+  coordinates.reserve(sinks.size()); // Pre-allocate for efficiency
   for (const auto &sink : sinks) {
-    xCoordinates.push_back(sink.x);
-  }
-  sort(xCoordinates.begin(), xCoordinates.end());
-  if (xCoordinates.size() % 2 == 0) {
-    // Even number of elements, take the average of the middle two
-    size_t middleIndex = xCoordinates.size() / 2;
-    return (xCoordinates[middleIndex - 1] + xCoordinates[middleIndex]) / 2;
+    coordinates.push_back(sink.*axis);
+  }
+  size_t middleIndex = coordinates.size() / 2;
+  nth_element(coordinates.begin(), coordinates.begin() + middleIndex,
+              coordinates.end());
+  if (coordinates.size() % 2 == 0) {
+    // Even number of elements, the lower middle one is the largest element
+    // left of the upper middle one
+    int lowerMiddle = *max_element(coordinates.begin(),
+                                   coordinates.begin() + middleIndex);
+    return (lowerMiddle + coordinates[middleIndex]) / 2;
   } else {
     // Odd number of elements, take the middle element
-    return xCoordinates[xCoordinates.size() / 2];
+    return coordinates[middleIndex];
   }
 }
+
+// Function to calculate the median of x coordinates
+int calculateMedianX(SinkSpan sinks) {
+  return calculateMedian(sinks, &Sink::x);
+}
 // Function to calculate the median of y coordinates
-int calculateMedianY(const vector<Sink> &sinks) {
-  vector<int> yCoordinates;
-  yCoordinates.reserve(sinks.size()); // Pre-allocate for efficiency
-  for (const auto &sink : sinks) {
-    yCoordinates.push_back(sink.y);
-  }
-  sort(yCoordinates.begin(), yCoordinates.end());
-  if (yCoordinates.size() % 2 == 0) {
-    // Even number of elements, take the average of the middle two
-    size_t middleIndex = yCoordinates.size() / 2;
-    return (yCoordinates[middleIndex - 1] + yCoordinates[middleIndex]) / 2;
-  } else {
-    // Odd number of elements, take the middle element
-    return yCoordinates[yCoordinates.size() / 2];
+int calculateMedianY(SinkSpan sinks) {
+  return calculateMedian(sinks, &Sink::y);
+}
+
+// Bounding box of a set of sinks in all three dimensions
+struct SinkBounds {
+  int minX, maxX;
+  int minY, maxY;
+  int minZ, maxZ;
+};
+
+// All six extremes in a single branch free pass, instead of one scan per
+// getMin/getMax call
+SinkBounds getBounds(SinkSpan sinks) {
+  if (sinks.empty()) {
+    throw runtime_error("No sinks available to determine bounds.");
   }
+  SinkBounds b = {sinks[0].x, sinks[0].x, sinks[0].y,
+                  sinks[0].y, sinks[0].z, sinks[0].z};
+  for (const auto &sink : sinks) {
+    b.minX = std::min(b.minX, sink.x);
+    b.maxX = std::max(b.maxX, sink.x);
+    b.minY = std::min(b.minY, sink.y);
+    b.maxY = std::max(b.maxY, sink.y);
+    b.minZ = std::min(b.minZ, sink.z);
+    b.maxZ = std::max(b.maxZ, sink.z);
+  }
+  return b;
 }
 
 // Function to return the minimum x value in the set of sinks
-int getMinX(const vector<Sink> &sinks) {
+int getMinX(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine minimum X.");
   }
@@ -108,7 +141,7 @@ int getMinX(const vector<Sink> &sinks) {
 }
 
 // Function to return the maximum x value in the set of sinks
-int getMaxX(const vector<Sink> &sinks) {
+int getMaxX(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine maximum X.");
   }
@@ -122,7 +155,7 @@ int getMaxX(const vector<Sink> &sinks) {
 }
 
 // Function to return the minimum y value in the set of sinks
-int getMinY(const vector<Sink> &sinks) {
+int getMinY(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine minimum Y.");
   }
@@ -136,7 +169,7 @@ int getMinY(const vector<Sink> &sinks) {
 }
 
 // Function to return the maximum y value in the set of sinks
-int getMaxY(const vector<Sink> &sinks) {
+int getMaxY(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine maximum Y.");
   }
@@ -150,7 +183,7 @@ int getMaxY(const vector<Sink> &sinks) {
 }
 
 // Function to return the minimum z value in the set of sinks
-int getMinZ(const vector<Sink> &sinks) {
+int getMinZ(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine minimum Z.");
   }
@@ -164,7 +197,7 @@ int getMinZ(const vector<Sink> &sinks) {
 }
 
 // Function to return the maximum z value in the set of sinks
-int getMaxZ(const vector<Sink> &sinks) {
+int getMaxZ(SinkSpan sinks) {
   if (sinks.empty()) {
     throw runtime_error("No sinks available to determine maximum Z.");
   }
@@ -177,12 +210,13 @@ int getMaxZ(const vector<Sink> &sinks) {
   return maxZ;
 }
 
-void cleanupPreviousFiles() {
+void cleanupPreviousFiles(const SynthesisContext &ctx) {
   // Delete DBSCAN results files
   for (int z = 1; z <= 10; z++) {
-    string dbscan_file = "dbscan_results_z_" + to_string(z) + ".csv";
-    string zeroskew_file =
-        "zeroskew_points_and_lines_z_" + to_string(z) + ".txt";
+    string dbscan_file =
+        ctx.outputPrefix + "dbscan_results_z_" + to_string(z) + ".csv";
+    string zeroskew_file = ctx.outputPrefix + "zeroskew_points_and_lines_z_" +
+                           to_string(z) + ".txt";
 
     // Remove files if they exist
     if (remove(dbscan_file.c_str()) == 0) {
@@ -194,12 +228,18 @@ void cleanupPreviousFiles() {
   }
 }
 
+void print_points(const std::string &label, const Point *first,
+                  const Point *last) {
+  ostream &out = logStream();
+  out << label << ": ";
+  for (const Point *point = first; point != last; ++point) {
+    out << "(" << point->x << ", " << point->y << ") ";
+  }
+  out << '\n';
+}
+
 void print_points(const std::string &label, const std::vector<Point> &points) {
-  std::cout << label << ": ";
-  for (const auto &point : points) {
-    std::cout << "(" << point.x << ", " << point.y << ") ";
-  }
-  std::cout << std::endl;
+  print_points(label, points.data(), points.data() + points.size());
 }
 
 Point roundCoordinates(const Point &p) {
@@ -211,23 +251,70 @@ Point roundCoordinates(const Point &p) {
   }
 }
 
-bool isCoordinateUsedByLeaf(Node *root, int x, int y) {
+// Leaf positions of one tree hashed on (x,y). Together with the preorder
+// interval kept on every node this answers "is (x,y) used by a leaf under
+// this node" without walking the subtree
+struct LeafOccupancy {
+  unordered_map<long long, vector<int>> leavesAt; // cell -> leaf preorders
+};
+long long cellKey(int x, int y) {
+  return (long long)((unsigned long long)(unsigned int)x << 32) ^
+         (unsigned int)y;
+}
+
+// Numbers the subtree in preorder starting at next, returns the next free
+// number
+int numberPreorder(Node *node, int next) {
+  if (!node)
+    return next;
+  node->preorder = next++;
+  next = numberPreorder(node->leftChild, next);
+  next = numberPreorder(node->rightChild, next);
+  node->preorderEnd = next;
+  return next;
+}
+
+void markLeafOccupied(LeafOccupancy &occupancy, const Node *leaf) {
+  occupancy.leavesAt[cellKey(leaf->x, leaf->y)].push_back(leaf->preorder);
+}
+
+void collectLeafOccupancy(LeafOccupancy &occupancy, const Node *node) {
+  if (!node)
+    return;
+  if (!node->leftChild && !node->rightChild) {
+    markLeafOccupied(occupancy, node);
+  }
+  collectLeafOccupancy(occupancy, node->leftChild);
+  collectLeafOccupancy(occupancy, node->rightChild);
+}
+
+// Builds the occupancy index for a tree whose leaves are already placed
+void buildLeafOccupancy(LeafOccupancy &occupancy, Node *root) {
+  occupancy.leavesAt.clear();
+  numberPreorder(root, 0);
+  collectLeafOccupancy(occupancy, root);
+}
+
+// Whether a leaf under root sits at (x,y). occupancy must be the index of
+// the tree root belongs to
+bool isCoordinateOccupied(const LeafOccupancy &occupancy, const Node *root,
+                          int x, int y) {
   if (!root)
     return false;
-
-  // If this is a leaf node (sink), check coordinates
-  if (!root->leftChild && !root->rightChild) {
-    if (root->x == x && root->y == y)
+  auto it = occupancy.leavesAt.find(cellKey(x, y));
+  if (it == occupancy.leavesAt.end())
+    return false;
+  for (int order : it->second) {
+    if (order >= root->preorder && order < root->preorderEnd)
       return true;
   }
-
-  // Recursively check children
-  return isCoordinateUsedByLeaf(root->leftChild, x, y) ||
-         isCoordinateUsedByLeaf(root->rightChild, x, y);
+  return false;
 }
-Point findNearestFreePoint(Node *root, Point original, int maxDistance = 5) {
+
+Point findNearestFreePoint(const LeafOccupancy &occupancy, Node *root,
+                           Point original, int maxDistance = 5) {
   // If original point is free, return it
-  if (!isCoordinateUsedByLeaf(root, original.x, original.y)) {
+  if (!isCoordinateOccupied(occupancy, root, original.x, original.y)) {
     return original;
   }
 
@@ -237,7 +324,7 @@ Point findNearestFreePoint(Node *root, Point original, int maxDistance = 5) {
     for (int dx = -d; dx <= d; dx++) {
       for (int dy = -d; dy <= d; dy++) {
         Point candidate = {original.x + dx, original.y + dy};
-        if (!isCoordinateUsedByLeaf(root, candidate.x, candidate.y)) {
+        if (!isCoordinateOccupied(occupancy, root, candidate.x, candidate.y)) {
           return candidate;
         }
       }
@@ -246,97 +333,138 @@ Point findNearestFreePoint(Node *root, Point original, int maxDistance = 5) {
   return original; // If no free point found, return original
 }
 
-// Function to parse input from a file
-void parseInput(const string &filename) {
-  ifstream inputFile(filename);
-  if (!inputFile.is_open()) {
-    cerr << "Error opening file!" << endl;
-    exit(1); // Exit if file cannot be opened
-  }
-  // Parse input file
-  inputFile >> layout.width >> layout.height >> layout.numDies;
-  inputFile.ignore(numeric_limits<streamsize>::max(),
-                   '\n'); // Ignore the rest of the line
-  inputFile >> wireUnits.resistance >> wireUnits.capacitance;
-  inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  inputFile >> bufferUnits.outputResistance >> bufferUnits.inputCapacitance >>
-      bufferUnits.intrinsicDelay;
-  inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  inputFile >> tsvUnits.resistance >> tsvUnits.capacitance;
-  inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  inputFile >> clockSource.x >> clockSource.y >> clockSource.z >>
-      clockSource.outputResistance;
-  inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  inputFile >> numSinks;
-  inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  for (int i = 0; i < numSinks; ++i) {
-    Sink sink;
-    inputFile >> sink.x >> sink.y >> sink.z >> sink.inputCapacitance;
-    sinks.push_back(sink);
-    inputFile.ignore(numeric_limits<streamsize>::max(), '\n');
-  }
-  inputFile.close();
-}
-
-void displayParsedData() {
-  cout << "Layout Area: (" << layout.width << "," << layout.height
-       << ")(x,y)(um)" << endl;
-  cout << "Number Of Dies: " << layout.numDies << endl;
-  cout << "Unit Wire Resistance: " << wireUnits.resistance << "(ohm/um)"
-       << endl;
-  cout << "Unit Wire Capacitance: " << wireUnits.capacitance << "(fF/um)"
-       << endl;
-  cout << "Buffer Output Resistance(ohm): " << bufferUnits.outputResistance
-       << endl;
-  cout << "Buffer Input Capacitance(fF): " << bufferUnits.inputCapacitance
-       << endl;
-  cout << "Buffer Intrinsic Delay(ps): " << bufferUnits.intrinsicDelay << endl;
-  cout << "TSV Resistance(ohm): " << tsvUnits.resistance << endl;
-  cout << "TSV Capacitance(fF): " << tsvUnits.capacitance << endl;
-  cout << "Clock Source: (" << clockSource.x << "," << clockSource.y << ","
-       << clockSource.z << ")(x,y,z) " << endl;
-  cout << "Clock Output resistance(ohm): " << clockSource.outputResistance
-       << endl;
-  cout << endl;
-  cout << "Sinks:" << endl;
+void displayParsedData(SynthesisContext &ctx) {
+  LOG_INFO("Layout Area: (" << ctx.layout.width << "," << ctx.layout.height
+           << ")(x,y)(um)");
+  LOG_INFO("Number Of Dies: " << ctx.layout.numDies);
+  LOG_INFO("Unit Wire Resistance: " << ctx.wireUnits.resistance << "(ohm/um)");
+  LOG_INFO("Unit Wire Capacitance: " << ctx.wireUnits.capacitance << "(fF/um)");
+  LOG_INFO("Buffer Output Resistance(ohm): "
+           << ctx.bufferUnits.outputResistance);
+  LOG_INFO("Buffer Input Capacitance(fF): "
+           << ctx.bufferUnits.inputCapacitance);
+  LOG_INFO("Buffer Intrinsic Delay(ps): " << ctx.bufferUnits.intrinsicDelay);
+  LOG_INFO("TSV Resistance(ohm): " << ctx.tsvUnits.resistance);
+  LOG_INFO("TSV Capacitance(fF): " << ctx.tsvUnits.capacitance);
+  LOG_INFO("Clock Source: (" << ctx.clockSource.x << "," << ctx.clockSource.y
+           << "," << ctx.clockSource.z << ")(x,y,z) ");
+  LOG_INFO("Clock Output resistance(ohm): "
+           << ctx.clockSource.outputResistance);
+  LOG_INFO("");
+  LOG_DEBUG("Sinks:");
+  SinkSpan sinks = designSinks(ctx);
   for (const auto &sink : sinks) {
-    cout << "(" << sink.x << "," << sink.y << "," << sink.z
-         << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance << " fF"
-         << endl;
+    LOG_DEBUG("(" << sink.x << "," << sink.y << "," << sink.z
+              << ")(x,y,z), Input Capacitance - " << sink.inputCapacitance
+              << " fF");
   }
-  cout << endl;
-  cout << "Median of x coordinates: " << calculateMedianX(sinks) << endl;
-  cout << "Median of y coordinates: " << calculateMedianY(sinks) << endl;
+  LOG_INFO("");
+  LOG_INFO("Median of x coordinates: " << calculateMedianX(sinks));
+  LOG_INFO("Median of y coordinates: " << calculateMedianY(sinks));
+}
+
+// Appends the decimal digits of value, without going through a stream
+void appendInt(std::string &out, int value) {
+  char digits[16];
+  std::to_chars_result result =
+      std::to_chars(digits, digits + sizeof digits, value);
+  out.append(digits, result.ptr);
 }
 
-void exportNode(Node *node, std::ofstream &file) {
+void appendPoint(std::string &out, const Node *node) {
+  appendInt(out, node->x);
+  out += ' ';
+  appendInt(out, node->y);
+}
+
+// Formats a subtree in the export file format, a "P x y" line per node and
+// an "L x1 y1 x2 y2" line per edge, in depth first order
+void exportNode(const Node *node, std::string &out) {
   if (!node) {
     return;
   }
   // Check if the node is a leaf node or MIV node
   bool isLeaf = node->leftChild == nullptr && node->rightChild == nullptr;
-  bool isMIV = node->node_type == "MIV";
+  bool isMIV = node->node_type == NodeType::MIV;
   // Export the current node with special notation for leaf nodes and MIVs
+  out += "P ";
+  appendPoint(out, node);
   if (isLeaf) {
-    file << "P " << node->x << " " << node->y << " (Leaf Node)" << std::endl;
+    out += " (Leaf Node)";
   } else if (isMIV) {
-    file << "P " << node->x << " " << node->y << " (MIV Node)" << std::endl;
-  } else {
-    file << "P " << node->x << " " << node->y << std::endl;
+    out += " (MIV Node)";
   }
+  out += '\n';
   // Export the lines to children
-  if (node->leftChild) {
-    file << "L " << node->x << " " << node->y << " " << node->leftChild->x
-         << " " << node->leftChild->y << std::endl;
-    exportNode(node->leftChild, file);
-  }
-  if (node->rightChild) {
-    file << "L " << node->x << " " << node->y << " " << node->rightChild->x
-         << " " << node->rightChild->y << std::endl;
-    exportNode(node->rightChild, file);
+  for (const Node *child : {node->leftChild, node->rightChild}) {
+    if (child) {
+      out += "L ";
+      appendPoint(out, node);
+      out += ' ';
+      appendPoint(out, child);
+      out += '\n';
+      exportNode(child, out);
+    }
   }
 }
+// Formats one subtree block of a tier export file
+void exportSubtree(const Node *root, std::string &out) {
+  // Add separator between subtrees
+  out += "\n# New Subtree\n";
+  exportNode(root, out);
+}
 
+// Writes the subtree blocks of one tier export file. The file is opened
+// once, and the blocks are formatted into a buffer that goes out in large
+// writes, with no flush per line
+class TierExporter {
+public:
+  static const size_t bufferSize = 1 << 20;
+
+  explicit TierExporter(const std::string &filename)
+      : file(filename, std::ios::trunc) {
+    if (!file.is_open()) {
+      std::cerr << "Error opening file for writing: " << filename
+                << std::endl;
+    }
+    buffer.reserve(bufferSize);
+  }
+  ~TierExporter() { flush(); }
+  TierExporter(const TierExporter &) = delete;
+  TierExporter &operator=(const TierExporter &) = delete;
+
+  void addSubtree(const Node *root) {
+    exportSubtree(root, buffer);
+    flushFull();
+  }
+  // A block formatted earlier by exportSubtree
+  void addBlock(const std::string &block) {
+    buffer += block;
+    flushFull();
+  }
+  bool is_open() const { return file.is_open(); }
+
+  void flush() {
+    if (file.is_open() && !buffer.empty()) {
+      file.write(buffer.data(), buffer.size());
+      file.flush();
+    }
+    buffer.clear();
+  }
+
+private:
+  void flushFull() {
+    if (buffer.size() >= bufferSize) {
+      flush();
+    }
+  }
+
+  std::ofstream file;
+  std::string buffer;
+};
+
+// Appends one subtree to a tier export file. Opens the file per call,
+// TierExporter writes a whole tier at once
 void exportPointsAndLines(Node *root, const std::string &filename) {
   // Open file in append mode
   std::ofstream file(filename, std::ios::app);
@@ -345,8 +473,7 @@ void exportPointsAndLines(Node *root, const std::string &filename) {
     return;
   }
 
-  // Add separator between subtrees
-  file << "\n# New Subtree\n";
-  exportNode(root, file);
-  file.close();
+  std::string block;
+  exportSubtree(root, block);
+  file << block;
 }